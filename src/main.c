@@ -1,11 +1,13 @@
 #include <pebble.h>
+#include "tzrules.h"
 
 /*
  * TODO Don't listen for taps if there are too few TZs
  * TODO BUG: persisting offset is returning status_t 4, even though it looks like it is working. A problem?
- * TODO BUG Elipsis for label truncation does not work in current font
  * TODO Add Internet message as a replacement for a TZ (configure update frequency, show as stale if cannot update)
  * TODO Hide battery and bluetooth when connected/more than 50% full (option)
+ * DONE BUG Elipsis for label truncation does not work in current font
+ *      Solution: labels are measured and truncated with "..." when configured, not by the text layer.
  * DONE Move Pop? to RHS
  * DONE BUG: when the current TZ is not in the first 4 TZs we get an intermittent crash.
  *      Solution: s_display was being overrun as we accidently searched for 5 timezones.
@@ -33,15 +35,15 @@
  * DONE BUG: when switching to GlobalTime from World Watch, the TZs are not correctly updated. Possibly because WW sends a message we don't interpret. Partially fixed by persisting offsets, but problem is JS is not loading fast enough.
  */
   
-// Keys for timezone names
-#define KEY_TZ1 6601
-#define KEY_TZ2 6602
-#define KEY_TZ3 6603
-#define KEY_TZ4 6604
-#define KEY_TZ5 6605
-#define KEY_TZ6 6606
-#define KEY_TZ7 6607
-#define KEY_TZ8 6608
+// Key for the timezone IDs, CONFIG_SIZE packed uint16 (little-endian)
+#define KEY_ZONES 6600
+
+// Key for the timezone offsets, CONFIG_SIZE packed int16 (little-endian)
+#define KEY_OFFSETS 6610
+
+// Keys for timezone names and offsets persisted by earlier versions, one per timezone
+#define KEY_LEGACY_TZ1 6601
+#define KEY_LEGACY_OFFSET1 6611
 
 // Keys for labels
 #define KEY_LABEL1 6621
@@ -53,25 +55,35 @@
 #define KEY_LABEL7 6627
 #define KEY_LABEL8 6628
 
-// Keys for timezone offsets
-#define KEY_OFFSET1 6611
-#define KEY_OFFSET2 6612
-#define KEY_OFFSET3 6613
-#define KEY_OFFSET4 6614
-#define KEY_OFFSET5 6615
-#define KEY_OFFSET6 6616
-#define KEY_OFFSET7 6617
-#define KEY_OFFSET8 6618
+// Key for the phone's local UTC offset (minutes east of UTC)
+#define KEY_UTC_OFFSET 6631
+
+// Key for the persisted cache of offset tables
+#define KEY_OFFSET_CACHE 6632
+
+// Key for the persisted battery log, and to request/export it
+#define KEY_BATTERY_LOG 6641
+
+// Key for the popup seconds option
+#define KEY_POPUP_SECONDS 6651
+
+// Key for the timezone transitions either side of now, fetched to scrub the popup through time
+#define KEY_TRANSITIONS 6661
   
 #define CONFIG_SIZE (8)
   
 #define DISPLAY_SIZE (5)
 
-// Timezone string size (max)
-#define TZ_SIZE (100)
-  
 // Label string size (max)
 #define LABEL_SIZE (50)
+// Size of a zone name persisted by earlier versions, including terminating null
+#define LEGACY_TZ_SIZE (100)
+
+// Displayed label size, with room for the stale marker and the ellipsis
+#define LABEL_TEXT_SIZE (LABEL_SIZE + 4)
+
+// Appended to labels truncated to fit, the font has no ellipsis character
+#define LABEL_ELLIPSIS "..."
   
 // Display the local time
 #define DISPLAY_LOCAL_TIME (-1)
@@ -84,9 +96,43 @@
 
 // Popup pending time
 #define POPUP_PENDING_TIMEOUT_MS (3000)
+
+// Retry interval for unanswered offset requests, doubled on each retry
+#define REQUEST_RETRY_MIN_S (60)
+#define REQUEST_RETRY_MAX_S (3600)
+
+// Retries, and their interval, of an offset request the outbox refused, before waiting for the next tick
+#define REQUEST_BUSY_RETRIES (5)
+#define REQUEST_BUSY_RETRY_MS (1000)
+
+// Clock jumps taken as a change of local timezone: whole quarter hours, within the range of UTC offsets
+#define TRAVEL_JUMP_MIN_MINUTES (-12 * 60)
+#define TRAVEL_JUMP_MAX_MINUTES (14 * 60)
+
+// Number of offset tables remembered for recently visited local timezones
+#define OFFSET_CACHE_SIZE (3)
+
+// Number of battery log records kept, limited by the persistent storage size of a key
+#define BATTERY_LOG_SIZE (20)
+
+// A tap this soon after opening the popup shows the battery log instead of closing it
+#define BATTERY_LOG_TAP_MS (1000)
+
+// Taps this soon after the previous one are the same shake, and ignored
+#define TAP_BURST_MS (300)
+
+// Hours the popup can be scrubbed ahead of now, a shake an hour: the shake after the last closes it
+#define SCRUB_HOURS (12)
+
+// Days either side of now the phone's transitions cover, enough for the scrub hours
+#define SCRUB_WINDOW_DAYS (1)
+
+// Transitions kept per timezone from the phone's transition window, two DST changes and spare
+#define SCRUB_TRANSITIONS (4)
   
 static Window *s_main_window;
 static Window *s_popup_window;
+static Window *s_battery_window;
 static char build_time[100];
 
 static TextLayer *s_tz_label_layer[4];
@@ -101,18 +147,29 @@ static TextLayer *s_local_date_layer;
 // Text storage for status layer
 static char s_status_label_text[LABEL_SIZE];
 
-// Text storage for TZ label display
-static char s_tz_label_text[4][LABEL_SIZE];
+// Labels as displayed on the main and popup windows, by configured timezone:
+// marked "?" while the offsets are out of date and truncated to fit. Laid out
+// when the labels, or whether they are out of date, change, not on each tick.
+static char s_tz_label_text[CONFIG_SIZE][LABEL_TEXT_SIZE];
+static char s_popup_label_text[CONFIG_SIZE][LABEL_TEXT_SIZE];
+static bool s_labels_laid_out = false;
+static bool s_labels_stale = false;
 
 // Popup data
 static TextLayer *s_popup_label_layer[CONFIG_SIZE];
 static TextLayer *s_popup_time_layer[CONFIG_SIZE];
-static char s_popup_label_text[CONFIG_SIZE][LABEL_SIZE];
 
 #define LAYER_TZ_LABEL_WIDTH (104)
 #define LAYER_TZ_TIME_WIDTH (40)
 #define LAYER_TZ_HEIGHT (21)
 
+// Seconds column on the popup, when enabled, taken from the label width.
+#define LAYER_TZ_SECONDS_WIDTH (24)
+#define LAYER_TZ_SECONDS_TOP (3)
+
+// Wide enough to measure any label on a single line.
+#define LABEL_LAYOUT_WIDTH (1000)
+
 #define LAYER_LOCAL_WIDTH (144)
 #define LAYER_LOCAL_TIME_HEIGHT (36)
 #define LAYER_LOCAL_DATE_HEIGHT (32)
@@ -121,6 +178,9 @@ static GFont s_big_font = NULL;
 static GFont s_medium_font = NULL;
 static GFont s_small_font = NULL;
 
+// Never shown, used to measure labels in the small font: SDK 2 measures text only in a layer or a draw context.
+static TextLayer *s_label_measure_layer = NULL;
+
 static GBitmap *s_bmp_bt = NULL;
 static GBitmap *s_bmp_nobt = NULL;
 static GBitmap *s_bmp_battery[10];
@@ -133,40 +193,167 @@ static int32_t s_offset[CONFIG_SIZE];
 // Labels for configured timezones.
 static char s_label[CONFIG_SIZE][LABEL_SIZE];
 
-// Configured timezones, NULL for no display.
-static char s_tz[CONFIG_SIZE][TZ_SIZE];
+// Configured timezone IDs, TZRULES_NO_ZONE for no display.
+static uint16_t s_zone[CONFIG_SIZE];
+
+// Timezones are still configured by name, as persisted by an earlier version,
+// until the phone sends their IDs.
+static bool s_zones_legacy = false;
 
 // Previous time we displayed.
 static time_t s_last_tick = 0;
 
+// Time model, shared by the main and popup windows.
+// Formatted times for configured timezones, empty for no display.
+static char s_model_time[CONFIG_SIZE][sizeof("00:00")];
+static char s_model_local_time[sizeof("00:00")];
+static char s_model_local_date[20];
+
 // Number of displayed timezones
 static int s_num_display = 0;
 
 // Track whether we've checked the offsets since the last change
 static bool s_offsets_up_to_date = false;
 
-// Indexes into the s_tz/s_offset array,
+// When to next ask the phone for offsets, 0 for as soon as needed, and the backoff before the one after.
+static time_t s_next_request = 0;
+static int32_t s_request_retry_s = REQUEST_RETRY_MIN_S;
+
+// Offset request refused by a busy outbox: retries so far, and the timer for the next one
+static uint8_t s_request_busy_count = 0;
+static AppTimer *s_request_timer_handle = NULL;
+
+// Offsets were taken from the cache or the timezone rules, still to be confirmed by the phone
+static bool s_offsets_provisional = false;
+
+// Whether the timezone rules resource can be used to compute offsets on the watch.
+static bool s_rules_available = false;
+
+// Next time (UTC) one of the configured timezones changes offset according to the rules, 0 for none.
+static time_t s_rules_next_transition = 0;
+
+// Local UTC offset (minutes east) the current offsets are relative to, if known.
+static int32_t s_utc_offset = 0;
+static bool s_utc_offset_known = false;
+
+// Offsets for a given local UTC offset, persisted so that travellers get
+// correct times as soon as the watch moves between familiar timezones.
+typedef struct {
+  int16_t utc_offset;
+  int16_t offset[CONFIG_SIZE];
+} OffsetTable;
+
+// Most recently used first.
+static OffsetTable s_offset_cache[OFFSET_CACHE_SIZE];
+static int s_offset_cache_count = 0;
+
+// Indexes into the s_zone/s_offset array,
 // DISPLAY_LOCAL_TIME for the current time,
 // DISPLAY_NO_DISPLAY for no display
 static int s_display[DISPLAY_SIZE];
 
-// Indexes into s_tz/s_offset array for popup display.
+// Indexes into s_zone/s_offset array for popup display.
 static int s_p_display[CONFIG_SIZE];
 
 // Remember the last BT connection state.
 static bool s_last_bt_connected = true;
 
-// Popup control: 0 - no popup, 1 - popup pending, 2 - popup displayed
+// Popup control: 0 - no popup, 1 - popup pending, 2 - popup displayed, 3 - battery log displayed
 static int s_popup_state = false;
 
+// When the popup was opened, to spot a quick tap for the battery log.
+static time_t s_popup_opened_s = 0;
+static uint16_t s_popup_opened_ms = 0;
+
+// When the last tap came, to ignore the rest of a shake.
+static time_t s_last_tap_s = 0;
+static uint16_t s_last_tap_ms = 0;
+
 // Remember the popup timer handle to allow it to be cancelled
 static AppTimer *s_popup_timer_handle = NULL;
 
+// Popup seconds option: while the popup is displayed tick every second and
+// redraw only the seconds column. All timezones share the local seconds.
+static bool s_popup_seconds = false;
+static bool s_popup_seconds_active = false;
+static int s_popup_second = 0;
+static Layer *s_popup_seconds_layer = NULL;
+static char s_popup_seconds_text[sizeof(":00")];
+
+// Popup scrubbing: whole hours ahead of now the popup shows, 0 for now.
+static int s_scrub_hours = 0;
+static char s_scrub_time[CONFIG_SIZE][sizeof("00:00")];
+
+// Offsets over the scrub window, from the phone, for timezones the rules cannot resolve.
+typedef struct {
+  int16_t offset;
+  uint8_t count;
+  uint32_t at[SCRUB_TRANSITIONS];
+  int16_t next_offset[SCRUB_TRANSITIONS];
+} ScrubZone;
+static ScrubZone s_scrub_zone[CONFIG_SIZE];
+static bool s_scrub_window_valid = false;
+static bool s_scrub_window_requested = false;
+
+// Cost of the popup seconds option: second tick wakeups, seconds column redraws and pixels redrawn.
+static struct {
+  uint32_t wakeups;
+  uint32_t redraws;
+  uint32_t redraw_area;
+} s_seconds_stats;
+
+// Pending display work, accumulated by the event handlers and flushed once
+// per event loop turn so that bursts of events only cost a single render.
+#define DIRTY_TIME (1 << 0)
+#define DIRTY_STATUS (1 << 1)
+static uint8_t s_dirty = 0;
+
+// Timer used to run the coalesced update on the next event loop turn.
+static AppTimer *s_flush_timer_handle = NULL;
+
+// Activity since the last battery log record.
+static struct {
+  uint16_t ticks;
+  uint16_t requests;
+  uint16_t popups;
+} s_activity;
+
+// Battery log record, exported to the phone as is (little-endian, 12 bytes). The time is UTC,
+// unless flagged as local time as the UTC offset was not yet known, so records stay in order
+// across changes of timezone.
+#define BATTERY_PLUGGED (1 << 0)
+#define BATTERY_CHARGING (1 << 1)
+#define BATTERY_LOCAL_TIME (1 << 2)
+typedef struct {
+  uint32_t time;
+  uint8_t percent;
+  uint8_t flags;
+  uint16_t ticks;
+  uint16_t requests;
+  uint16_t popups;
+} BatteryRecord;
+
+// Ring of battery records, persisted as a whole on each change.
+static struct {
+  uint8_t head;
+  uint8_t count;
+  BatteryRecord records[BATTERY_LOG_SIZE];
+} s_battery_log;
+
+// Battery log display
+#define BATTERY_LOG_LINES (9)
+static TextLayer *s_battery_log_layer = NULL;
+static char s_battery_log_text[BATTERY_LOG_LINES * 32 + 20];
+
 static void update_time();
-static void send_tz_request();
+static bool send_tz_request();
 static void create_layers();
 static void create_popup_layers();
 static void update_status();
+static void send_battery_log();
+static void update_battery_log_text();
+static void mark_dirty(uint8_t flags);
+static void load_scrub_window(const uint8_t *data, uint16_t length);
 
 // Compare and swap indexes based on the offsets they refer to.
 static void compare_swap(int index[], int i) {
@@ -251,9 +438,10 @@ static void sort_times() {
 
   for (int i = 0; i < s_num_display; i++) {
     int x = s_display[i];
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Ordered list %d: %s (%ld)",
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Ordered list %d: %s %u (%ld)",
               i,
-              (x == DISPLAY_LOCAL_TIME) ? "LOCAL" : s_tz[x],
+              (x == DISPLAY_LOCAL_TIME) ? "LOCAL" : "zone",
+              (x == DISPLAY_LOCAL_TIME) ? 0 : s_zone[x],
               (x == DISPLAY_LOCAL_TIME) ? 0 : s_offset[x]);
   }
   
@@ -284,154 +472,229 @@ static void sort_times() {
   APP_LOG(APP_LOG_LEVEL_DEBUG, "...sort_times");
 }
 
-static void inbox_received_callback(DictionaryIterator *received, void *context) {
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Received message");
-  Tuple *o1_tuple = dict_find(received, KEY_OFFSET1);
-  Tuple *o2_tuple = dict_find(received, KEY_OFFSET2);
-  Tuple *o3_tuple = dict_find(received, KEY_OFFSET3);
-  Tuple *o4_tuple = dict_find(received, KEY_OFFSET4);
-  Tuple *o5_tuple = dict_find(received, KEY_OFFSET5);
-  Tuple *o6_tuple = dict_find(received, KEY_OFFSET6);
-  Tuple *o7_tuple = dict_find(received, KEY_OFFSET7);
-  Tuple *o8_tuple = dict_find(received, KEY_OFFSET8);
-
-  if (o1_tuple) {
-    s_offset[0] = o1_tuple->value->int32;
-    status_t s = persist_write_int(KEY_OFFSET1, s_offset[0]);
-    if (s != S_SUCCESS) {
-      APP_LOG(APP_LOG_LEVEL_WARNING, "Failed to remember TZ offset: %ld", s);
-    }
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Offset 1: %ld", s_offset[0]);
+static void save_offsets() {
+  int16_t offset[CONFIG_SIZE];
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    offset[i] = s_offset[i];
   }
-  
-  if (o2_tuple) {
-    s_offset[1] = o2_tuple->value->int32;
-    status_t s = persist_write_int(KEY_OFFSET2, s_offset[1]);
-    if (s != S_SUCCESS) {
-      APP_LOG(APP_LOG_LEVEL_WARNING, "Failed to remember TZ offset: %ld", s);
-    }
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Offset 2: %ld", s_offset[1]);
+  int s = persist_write_data(KEY_OFFSETS, offset, sizeof(offset));
+  if (s < 0) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Failed to remember TZ offsets: %d", s);
   }
-  
-  if (o3_tuple) {
-    s_offset[2] = o3_tuple->value->int32;
-    status_t s = persist_write_int(KEY_OFFSET3, s_offset[2]);
-    if (s != S_SUCCESS) {
-      APP_LOG(APP_LOG_LEVEL_WARNING, "Failed to remember TZ offset: %ld", s);
-    }
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Offset 3: %ld", s_offset[2]);
+}
+
+static void load_offsets() {
+  int16_t offset[CONFIG_SIZE];
+  bool packed = persist_read_data(KEY_OFFSETS, offset, sizeof(offset)) == sizeof(offset);
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    // Fall back to the offsets persisted one per key by earlier versions.
+    s_offset[i] = packed ? offset[i] : persist_read_int(KEY_LEGACY_OFFSET1 + i);
   }
-  
-  if (o4_tuple) {
-    s_offset[3] = o4_tuple->value->int32;
-    status_t s = persist_write_int(KEY_OFFSET4, s_offset[3]);
-    if (s != S_SUCCESS) {
-      APP_LOG(APP_LOG_LEVEL_WARNING, "Failed to remember TZ offset: %ld", s);
-    }
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Offset 4: %ld", s_offset[3]);
+}
+
+// Remove the configuration persisted by earlier versions, once replaced by zone IDs.
+static void delete_legacy_config() {
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    persist_delete(KEY_LEGACY_TZ1 + i);
+    persist_delete(KEY_LEGACY_OFFSET1 + i);
   }
-  
-  if (o5_tuple) {
-    s_offset[4] = o5_tuple->value->int32;
-    status_t s = persist_write_int(KEY_OFFSET5, s_offset[4]);
-    if (s != S_SUCCESS) {
-      APP_LOG(APP_LOG_LEVEL_WARNING, "Failed to remember TZ offset: %ld", s);
-    }
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Offset 5: %ld", s_offset[4]);
+  s_zones_legacy = false;
+}
+
+static void save_offset_cache() {
+  int s = persist_write_data(KEY_OFFSET_CACHE, s_offset_cache, s_offset_cache_count * sizeof(OffsetTable));
+  if (s < 0) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Failed to remember offset cache: %d", s);
   }
-  
-  if (o6_tuple) {
-    s_offset[5] = o6_tuple->value->int32;
-    status_t s = persist_write_int(KEY_OFFSET6, s_offset[5]);
-    if (s != S_SUCCESS) {
-      APP_LOG(APP_LOG_LEVEL_WARNING, "Failed to remember TZ offset: %ld", s);
+}
+
+static void load_offset_cache() {
+  int s = persist_read_data(KEY_OFFSET_CACHE, s_offset_cache, sizeof(s_offset_cache));
+  s_offset_cache_count = (s > 0) ? s / (int) sizeof(OffsetTable) : 0;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Loaded %d cached offset tables", s_offset_cache_count);
+}
+
+static void clear_offset_cache() {
+  s_offset_cache_count = 0;
+  persist_delete(KEY_OFFSET_CACHE);
+}
+
+// Move cache entry i to the front, shuffling the more recent entries down.
+static void promote_offset_cache(int i, OffsetTable *table) {
+  for (; i > 0; i--) {
+    s_offset_cache[i] = s_offset_cache[i - 1];
+  }
+  s_offset_cache[0] = *table;
+}
+
+// Remember the current offsets against the current local UTC offset.
+static void store_offset_cache() {
+  OffsetTable table;
+  table.utc_offset = s_utc_offset;
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    table.offset[i] = s_offset[i];
+  }
+
+  int i = 0;
+  while (i < s_offset_cache_count && s_offset_cache[i].utc_offset != table.utc_offset) {
+    i++;
+  }
+  if (i == s_offset_cache_count) {
+    if (s_offset_cache_count < OFFSET_CACHE_SIZE) {
+      s_offset_cache_count++;
+    } else {
+      // Evict the least recently used table
+      i = OFFSET_CACHE_SIZE - 1;
     }
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Offset 6: %ld", s_offset[5]);
+  } else if (0 == i && 0 == memcmp(&s_offset_cache[0], &table, sizeof(table))) {
+    // Already the most recent entry, save a persistent write
+    return;
   }
-  
-  if (o7_tuple) {
-    s_offset[6] = o7_tuple->value->int32;
-    status_t s = persist_write_int(KEY_OFFSET7, s_offset[6]);
-    if (s != S_SUCCESS) {
-      APP_LOG(APP_LOG_LEVEL_WARNING, "Failed to remember TZ offset: %ld", s);
+
+  promote_offset_cache(i, &table);
+  save_offset_cache();
+}
+
+// Switch to the cached offsets for the given local UTC offset, if we have them.
+static bool apply_offset_cache(int32_t utc_offset) {
+  for (int i = 0; i < s_offset_cache_count; i++) {
+    if (s_offset_cache[i].utc_offset == utc_offset) {
+      OffsetTable table = s_offset_cache[i];
+      for (int j = 0; j < CONFIG_SIZE; j++) {
+        s_offset[j] = table.offset[j];
+      }
+      s_utc_offset = utc_offset;
+
+      if (i > 0) {
+        promote_offset_cache(i, &table);
+        save_offset_cache();
+      }
+
+      APP_LOG(APP_LOG_LEVEL_INFO, "Using cached offsets for UTC offset %ld", utc_offset);
+      return true;
     }
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Offset 7: %ld", s_offset[6]);
+  }
+
+  return false;
+}
+
+// Compute offsets for the configured timezones from the rules, relative to the local UTC offset.
+// Returns false if the rules cannot resolve all of them.
+static bool rules_offsets(time_t now, int32_t offset[], time_t *next_transition) {
+  if (!s_rules_available || !s_utc_offset_known || s_zones_legacy) {
+    return false;
   }
   
-  if (o8_tuple) {
-    s_offset[7] = o8_tuple->value->int32;
-    status_t s = persist_write_int(KEY_OFFSET8, s_offset[7]);
-    if (s != S_SUCCESS) {
-      APP_LOG(APP_LOG_LEVEL_WARNING, "Failed to remember TZ offset: %ld", s);
+  time_t utc = now - s_utc_offset * 60;
+  *next_transition = 0;
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    if (TZRULES_NO_ZONE == s_zone[i]) {
+      offset[i] = OFFSET_NO_DISPLAY;
+      continue;
+    }
+    
+    int32_t zone_offset;
+    time_t zone_next;
+    if (!tzrules_offset(s_zone[i], utc, &zone_offset, &zone_next)) {
+      return false;
+    }
+    offset[i] = zone_offset - s_utc_offset;
+    if (zone_next && (!*next_transition || zone_next < *next_transition)) {
+      *next_transition = zone_next;
     }
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Offset 8: %ld", s_offset[7]);
   }
   
-  
-  Tuple *tz1_tuple = dict_find(received, KEY_TZ1);
-  Tuple *tz2_tuple = dict_find(received, KEY_TZ2);
-  Tuple *tz3_tuple = dict_find(received, KEY_TZ3);
-  Tuple *tz4_tuple = dict_find(received, KEY_TZ4);
-  Tuple *tz5_tuple = dict_find(received, KEY_TZ5);
-  Tuple *tz6_tuple = dict_find(received, KEY_TZ6);
-  Tuple *tz7_tuple = dict_find(received, KEY_TZ7);
-  Tuple *tz8_tuple = dict_find(received, KEY_TZ8);
-  bool tz_set = false;
-  
-  if (tz1_tuple) {
-    strncpy(s_tz[0], tz1_tuple->value->cstring, TZ_SIZE);
-    persist_write_string(KEY_TZ1, s_tz[0]);
-    APP_LOG(APP_LOG_LEVEL_INFO, "Configuration: TZ 1: %s", s_tz[0]);
-    tz_set = true;
+  return true;
+}
+
+// Switch to offsets computed from the rules, re-sorting the display if they changed.
+static bool apply_rules_offsets(time_t now) {
+  int32_t offset[CONFIG_SIZE];
+  time_t next_transition;
+  if (!rules_offsets(now, offset, &next_transition)) {
+    return false;
   }
+  s_rules_next_transition = next_transition;
   
-  if (tz2_tuple) {
-    strncpy(s_tz[1], tz2_tuple->value->cstring, TZ_SIZE);
-    persist_write_string(KEY_TZ2, s_tz[1]);
-    APP_LOG(APP_LOG_LEVEL_INFO, "Configuration: TZ 2: %s", s_tz[1]);
-    tz_set = true;
+  bool changed = false;
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    if (s_offset[i] != offset[i]) {
+      s_offset[i] = offset[i];
+      changed = true;
+    }
   }
   
-  if (tz3_tuple) {
-    strncpy(s_tz[2], tz3_tuple->value->cstring, TZ_SIZE);
-    persist_write_string(KEY_TZ3, s_tz[2]);
-    APP_LOG(APP_LOG_LEVEL_INFO, "Configuration: TZ 3: %s", s_tz[2]);
-    tz_set = true;
+  APP_LOG(APP_LOG_LEVEL_INFO, "Offsets computed from timezone rules%s", changed ? ", changed" : "");
+  if (changed) {
+    sort_times();
   }
-   
-  if (tz4_tuple) {
-    strncpy(s_tz[3], tz4_tuple->value->cstring, TZ_SIZE);
-    persist_write_string(KEY_TZ4, s_tz[3]);
-    APP_LOG(APP_LOG_LEVEL_INFO, "Configuration: TZ 4: %s", s_tz[3]);
-    tz_set = true;
+  return true;
+}
+
+// Ask the phone for offsets on the next update, and back off afresh if it does not answer.
+static void reset_request_backoff() {
+  s_next_request = 0;
+  s_request_retry_s = REQUEST_RETRY_MIN_S;
+}
+
+static void inbox_received_callback(DictionaryIterator *received, void *context) {
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Received message");
+  if (dict_find(received, KEY_BATTERY_LOG)) {
+    // Export request from the phone, not configuration
+    send_battery_log();
+    return;
   }
-  
-  if (tz5_tuple) {
-    strncpy(s_tz[4], tz5_tuple->value->cstring, TZ_SIZE);
-    persist_write_string(KEY_TZ5, s_tz[4]);
-    APP_LOG(APP_LOG_LEVEL_INFO, "Configuration: TZ 5: %s", s_tz[4]);
-    tz_set = true;
+
+  Tuple *transitions_tuple = dict_find(received, KEY_TRANSITIONS);
+  if (transitions_tuple) {
+    // Scrub window, not offsets for now
+    load_scrub_window(transitions_tuple->value->data, transitions_tuple->length);
+    mark_dirty(DIRTY_TIME);
+    return;
   }
   
-  if (tz6_tuple) {
-    strncpy(s_tz[5], tz6_tuple->value->cstring, TZ_SIZE);
-    persist_write_string(KEY_TZ6, s_tz[5]);
-    APP_LOG(APP_LOG_LEVEL_INFO, "Configuration: TZ 6: %s", s_tz[5]);
-    tz_set = true;
+  Tuple *offsets_tuple = dict_find(received, KEY_OFFSETS);
+  if (offsets_tuple) {
+    int16_t offset[CONFIG_SIZE];
+    if (offsets_tuple->length == sizeof(offset)) {
+      memcpy(offset, offsets_tuple->value->data, sizeof(offset));
+      for (int i = 0; i < CONFIG_SIZE; i++) {
+        s_offset[i] = offset[i];
+        APP_LOG(APP_LOG_LEVEL_DEBUG, "Offset %d: %ld", i + 1, s_offset[i]);
+      }
+      save_offsets();
+    } else {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Ignoring TZ offsets of %u bytes", offsets_tuple->length);
+    }
   }
   
-  if (tz7_tuple) {
-    strncpy(s_tz[6], tz7_tuple->value->cstring, TZ_SIZE);
-    persist_write_string(KEY_TZ7, s_tz[6]);
-    APP_LOG(APP_LOG_LEVEL_INFO, "Configuration: TZ 7: %s", s_tz[6]);
-    tz_set = true;
+  Tuple *utc_tuple = dict_find(received, KEY_UTC_OFFSET);
+  if (utc_tuple) {
+    s_utc_offset = utc_tuple->value->int32;
+    s_utc_offset_known = true;
+    persist_write_int(KEY_UTC_OFFSET, s_utc_offset);
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "UTC offset: %ld", s_utc_offset);
   }
   
-  if (tz8_tuple) {
-    strncpy(s_tz[7], tz8_tuple->value->cstring, TZ_SIZE);
-    persist_write_string(KEY_TZ8, s_tz[7]);
-    APP_LOG(APP_LOG_LEVEL_INFO, "Configuration: TZ 8: %s", s_tz[7]);
-    tz_set = true;
+  Tuple *zones_tuple = dict_find(received, KEY_ZONES);
+  bool tz_set = false;
+  
+  if (zones_tuple) {
+    if (zones_tuple->length == sizeof(s_zone)) {
+      memcpy(s_zone, zones_tuple->value->data, sizeof(s_zone));
+      persist_write_data(KEY_ZONES, s_zone, sizeof(s_zone));
+      APP_LOG(APP_LOG_LEVEL_INFO, "Configuration: zones %u, %u, %u, %u, %u, %u, %u, %u",
+              s_zone[0], s_zone[1], s_zone[2], s_zone[3], s_zone[4], s_zone[5], s_zone[6], s_zone[7]);
+      if (s_zones_legacy) {
+        // The offsets were read from the per-zone keys: keep them packed before deleting those,
+        // so they survive a restart before the phone sends new ones.
+        save_offsets();
+        delete_legacy_config();
+      }
+      tz_set = true;
+    } else {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Ignoring zones of %u bytes", zones_tuple->length);
+    }
   }
   
   Tuple *l1_tuple = dict_find(received, KEY_LABEL1);
@@ -443,6 +706,10 @@ static void inbox_received_callback(DictionaryIterator *received, void *context)
   Tuple *l7_tuple = dict_find(received, KEY_LABEL7);
   Tuple *l8_tuple = dict_find(received, KEY_LABEL8);
   
+  if (l1_tuple || l2_tuple || l3_tuple || l4_tuple || l5_tuple || l6_tuple || l7_tuple || l8_tuple) {
+    s_labels_laid_out = false;
+  }
+  
   if (l1_tuple) {
     strncpy(s_label[0], l1_tuple->value->cstring, LABEL_SIZE);
     persist_write_string(KEY_LABEL1, s_label[0]);
@@ -491,14 +758,41 @@ static void inbox_received_callback(DictionaryIterator *received, void *context)
     APP_LOG(APP_LOG_LEVEL_DEBUG, "Configuration: LABEL 8: %s", s_label[7]);
   }
 
+  Tuple *seconds_tuple = dict_find(received, KEY_POPUP_SECONDS);
+  if (seconds_tuple) {
+    s_popup_seconds = seconds_tuple->value->int32 != 0;
+    persist_write_bool(KEY_POPUP_SECONDS, s_popup_seconds);
+    s_labels_laid_out = false;
+    APP_LOG(APP_LOG_LEVEL_INFO, "Configuration: popup seconds: %d", s_popup_seconds);
+    create_popup_layers();
+  }
+
   if (tz_set) {
-    send_tz_request();
+    // The time model update will request offsets for the new timezones
+    s_offsets_up_to_date = false;
+    s_offsets_provisional = false;
+    reset_request_backoff();
+    clear_offset_cache();
+    s_scrub_window_valid = false;
   } else {
     sort_times();
     s_offsets_up_to_date = true;
+    s_offsets_provisional = false;
+    reset_request_backoff();
+    if (utc_tuple) {
+      store_offset_cache();
+    }
+    
+    // Keep the phone's offsets, but note when the rules say one of them will next change.
+    int32_t offset[CONFIG_SIZE];
+    time_t now;
+    time(&now);
+    if (!rules_offsets(now, offset, &s_rules_next_transition)) {
+      s_rules_next_transition = 0;
+    }
   }
   
-  update_time();
+  mark_dirty(DIRTY_TIME);
 }
 
 // static void add_line(char *buffer, char *additional_line, bool first_line) {
@@ -512,73 +806,209 @@ static void set_status_text(char *msg) {
   strncpy(s_status_label_text, msg, sizeof(s_status_label_text));
 }
 
-static void update_time() {
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "UpdateTime...");
-  
-  // Create long lived buffers
-  static char s_local_time[20];
-  static char s_local_date[20];
-  static char s_tz_time[4][20];
-  char tt[20];
+// Retry an offset request the outbox refused, with the next update.
+static void request_timer_callback(void *data) {
+  s_request_timer_handle = NULL;
+  mark_dirty(DIRTY_TIME);
+}
 
+// Recompute the time model: the formatted times for all configured timezones
+// and the local time/date. Done once per tick, both windows render from it.
+static void update_time_model() {
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "update_time_model...");
+  
   // Get a tm structure
   time_t now;
   time(&now);
   APP_LOG(APP_LOG_LEVEL_DEBUG, "Localtime time: %ld", now);
     
   int32_t difference = now - s_last_tick;
-  if (difference > 360 || difference < -360 || !s_offsets_up_to_date) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Difference (%ld) is more than 6 minutes, or offsets out of date (%s), requesting TZ information again...",
-            difference, s_offsets_up_to_date ? "true" : "false");
+  bool jumped = (s_last_tick != 0) && (difference > 360 || difference < -360);
+  if (jumped) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Difference (%ld) is more than 6 minutes, requesting TZ information again...", difference);
     s_offsets_up_to_date = false;
-    send_tz_request();
+    reset_request_backoff();
+
+    // The jump less the usual tick, to the nearest minute
+    int32_t jump = (difference - 60 + (difference >= 60 ? 30 : -30)) / 60;
+    if (jump < TRAVEL_JUMP_MIN_MINUTES || jump > TRAVEL_JUMP_MAX_MINUTES || 0 != jump % 15) {
+      // The clock was set, rather than the local timezone changed: leave the UTC offset to the phone.
+      APP_LOG(APP_LOG_LEVEL_DEBUG, "Jump of %ld minutes is not a change of timezone", jump);
+    } else if (s_utc_offset_known) {
+      // Assume the local timezone changed by the jump.
+      // The rules follow DST changes in the configured timezones, so prefer them to the cache.
+      s_utc_offset += jump;
+      if (apply_rules_offsets(now)) {
+        s_offsets_up_to_date = true;
+        s_offsets_provisional = true;
+      } else if (apply_offset_cache(s_utc_offset)) {
+        // Show the cached offsets straight away, but keep asking the phone to confirm them.
+        s_offsets_up_to_date = true;
+        s_offsets_provisional = true;
+        sort_times();
+      }
+    }
+  }
+  
+  if (!s_offsets_up_to_date && apply_rules_offsets(now)) {
+    // Computed on the watch, but keep asking the phone to confirm them.
+    s_offsets_up_to_date = true;
+    s_offsets_provisional = true;
+  } else if (s_rules_next_transition && now - s_utc_offset * 60 >= s_rules_next_transition) {
+    // A configured timezone has changed offset (e.g. DST), no need to ask the phone.
+    apply_rules_offsets(now);
+  }
+
+  if ((!s_offsets_up_to_date || s_offsets_provisional) && now >= s_next_request) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Offsets out of date (%s) or provisional (%s), requesting TZ information again...",
+            s_offsets_up_to_date ? "false" : "true", s_offsets_provisional ? "true" : "false");
+    if (send_tz_request()) {
+      // Back off while the phone does not answer
+      s_next_request = now + s_request_retry_s;
+      s_request_retry_s = (2 * s_request_retry_s < REQUEST_RETRY_MAX_S) ? 2 * s_request_retry_s : REQUEST_RETRY_MAX_S;
+      s_request_busy_count = 0;
+    } else if (!s_request_timer_handle && s_request_busy_count < REQUEST_BUSY_RETRIES) {
+      // Nothing was sent, so no backoff: try again shortly, e.g. once a battery log export is done.
+      s_request_busy_count++;
+      s_request_timer_handle = app_timer_register(REQUEST_BUSY_RETRY_MS, request_timer_callback, NULL);
+    }
   }
   s_last_tick = now;
 
-  int d = 0;
-  for (int i = 0; i < s_num_display; i++) {
-    time_t temp = now;
-    
-    int display = s_display[i];
-    int offset = (DISPLAY_LOCAL_TIME == display) ? 0 : s_offset[display];
+  struct tm *tick_time = localtime(&now);
+  strftime(s_model_local_time, sizeof(s_model_local_time), clock_is_24h_style() ? "%H:%M" : "%I:%M", tick_time);
+  strftime(s_model_local_date, sizeof(s_model_local_date), "%a, %d %b", tick_time);
+
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    int offset = s_offset[i];
+    if (OFFSET_NO_DISPLAY == offset) {
+      s_model_time[i][0] = '\0';
+      continue;
+    }
 
     // Apply TZ offset
-    temp += offset * 60;
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Display %d time: %ld (%d)", i, temp, offset);
+    time_t temp = now + offset * 60;
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "TZ %d time: %ld (%d)", i, temp, offset);
 
-    struct tm *tick_time = localtime(&temp);
+    tick_time = localtime(&temp);
     
     // Write the current hours and minutes into the buffer
     if (clock_is_24h_style() == true) {
       // Use 24 hour format
-      strftime(tt, sizeof("00:00"), "%H:%M", tick_time);
+      strftime(s_model_time[i], sizeof(s_model_time[i]), "%H:%M", tick_time);
     } else {
       // Use 12 hour format
-      strftime(tt, sizeof("00:00"), "%I:%M", tick_time);
+      strftime(s_model_time[i], sizeof(s_model_time[i]), "%I:%M", tick_time);
+    }
+  }
+}
+
+static bool label_fits(const char *text, int16_t width) {
+  text_layer_set_text(s_label_measure_layer, text);
+  GSize size = text_layer_get_content_size(s_label_measure_layer);
+  return size.w <= width;
+}
+
+// Format a label for display, truncated on a character boundary with an ellipsis if it does not fit the width.
+static void fit_label(char *text, const char *label, bool stale, int16_t width) {
+  // The label comes from strncpy and may fill LABEL_SIZE without a terminating null
+  snprintf(text, LABEL_TEXT_SIZE, "%s%.*s", stale ? "?" : "", LABEL_SIZE - 1, label);
+  if (label_fits(text, width)) {
+    return;
+  }
+
+  // Byte offset of the end of each (UTF-8) character
+  uint8_t ends[LABEL_TEXT_SIZE];
+  int count = 0;
+  int length = strlen(text);
+  for (int i = 1; i <= length; i++) {
+    if (i == length || (text[i] & 0xc0) != 0x80) {
+      ends[count++] = i;
+    }
+  }
+
+  // Binary search for the most characters that fit with the ellipsis, none do if the search fails.
+  char trial[LABEL_TEXT_SIZE + sizeof(LABEL_ELLIPSIS)];
+  int lo = 0;
+  int hi = count;
+  while (hi - lo > 1) {
+    int mid = (lo + hi) / 2;
+    memcpy(trial, text, ends[mid - 1]);
+    strcpy(trial + ends[mid - 1], LABEL_ELLIPSIS);
+    if (label_fits(trial, width)) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  int cut = lo ? ends[lo - 1] : 0;
+  if (cut > LABEL_TEXT_SIZE - (int) sizeof(LABEL_ELLIPSIS)) {
+    cut = LABEL_TEXT_SIZE - sizeof(LABEL_ELLIPSIS);
+  }
+  strcpy(text + cut, LABEL_ELLIPSIS);
+}
+
+static int16_t popup_label_width() {
+  return LAYER_TZ_LABEL_WIDTH - (s_popup_seconds ? LAYER_TZ_SECONDS_WIDTH : 0);
+}
+
+static void set_main_labels() {
+  int d = 0;
+  for (int i = 0; i < s_num_display; i++) {
+    int display = s_display[i];
+    if (DISPLAY_LOCAL_TIME != display && s_tz_label_layer[d]) {
+      text_layer_set_text(s_tz_label_layer[d++], s_tz_label_text[display]);
+    }
+  }
+}
+
+static void set_popup_labels() {
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    int display = s_p_display[i];
+    if (s_popup_label_layer[i]) {
+      text_layer_set_text(s_popup_label_layer[i], (OFFSET_NO_DISPLAY != s_offset[display]) ? s_popup_label_text[display] : "");
     }
+  }
+}
+
+// Lay out the labels again if they, or whether the offsets are up to date, have changed.
+static void update_labels() {
+  bool stale = !s_offsets_up_to_date;
+  if (s_labels_laid_out && stale == s_labels_stale) {
+    return;
+  }
+
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Laying out labels...");
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    fit_label(s_tz_label_text[i], s_label[i], stale, LAYER_TZ_LABEL_WIDTH);
+    fit_label(s_popup_label_text[i], s_label[i], stale, popup_label_width());
+  }
+  s_labels_laid_out = true;
+  s_labels_stale = stale;
+
+  set_main_labels();
+  set_popup_labels();
+}
+
+// Render the main window from the time model.
+static void update_time() {
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "UpdateTime...");
+  update_labels();
+  
+  int d = 0;
+  for (int i = 0; i < s_num_display; i++) {
+    int display = s_display[i];
     
-    if (0 == offset) {
-      strncpy(s_local_time, tt, sizeof(s_local_time));
-      text_layer_set_text(s_local_time_layer, s_local_time);
-      
-      strftime(s_local_date, sizeof(s_local_date), "%a, %d %b", tick_time);
-      text_layer_set_text(s_local_date_layer, s_local_date);
+    if (DISPLAY_LOCAL_TIME == display) {
+      text_layer_set_text(s_local_time_layer, s_model_local_time);
+      text_layer_set_text(s_local_date_layer, s_model_local_date);
     } else {
-      s_tz_label_text[d][0] = '\0';
-      if (!s_offsets_up_to_date) {
-        strncat(s_tz_label_text[d], "?", 1);
-      }
-      strncat(s_tz_label_text[d], s_label[display], LABEL_SIZE - 1);
-      text_layer_set_text(s_tz_label_layer[d], s_tz_label_text[d]);
-      
-      strncpy(s_tz_time[d], tt, sizeof(s_tz_time[d]));
-      text_layer_set_text(s_tz_time_layer[d], s_tz_time[d]);
+      text_layer_set_text(s_tz_time_layer[d], s_model_time[display]);
               
       d++;
     }    
   }
-  
-  update_status();
 }
 
 static void update_status() {
@@ -606,61 +1036,107 @@ static void update_status() {
   text_layer_set_text(s_status_text_layer, s_status_label_text);
 }
 
-static void update_popup_time() {
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "update_popup_time...");
+// Offset (minutes east of UTC) of configured timezone i at a UTC time, from the rules,
+// or else the scrub window. Returns false if neither has it.
+static bool scrub_zone_offset(int i, time_t utc, int32_t *offset) {
+  time_t next_transition;
+  if (s_rules_available && !s_zones_legacy && tzrules_offset(s_zone[i], utc, offset, &next_transition)) {
+    return true;
+  }
+  if (!s_scrub_window_valid) {
+    return false;
+  }
   
-  // Create long lived buffers
-  static char s_popup_time[CONFIG_SIZE][20];
-  char tt[20];
-
-  // Get a tm structure
-  time_t now;
-  time(&now);
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Localtime time: %ld", now);
-    
-  int32_t difference = now - s_last_tick;
-  if (difference > 360 || difference < -360 || !s_offsets_up_to_date) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Difference (%ld) is more than 6 minutes, or offsets out of date (%s), requesting TZ information again...",
-            difference, s_offsets_up_to_date ? "true" : "false");
-    s_offsets_up_to_date = false;
-    send_tz_request();
+  ScrubZone *zone = &s_scrub_zone[i];
+  *offset = zone->offset;
+  for (int t = 0; t < zone->count && (uint32_t) (utc / 60) >= zone->at[t]; t++) {
+    *offset = zone->next_offset[t];
   }
-  s_last_tick = now;
+  return true;
+}
 
+// Whether a configured timezone needs the scrub window, as the rules cannot resolve it.
+static bool scrub_needs_window() {
+  time_t now = time(NULL);
   for (int i = 0; i < CONFIG_SIZE; i++) {
-    time_t temp = now;
-    
-    int display = s_p_display[i];
-    int offset = s_offset[display];
-
-    // Apply TZ offset
-    temp += offset * 60;
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Display %d time: %ld (%d)", i, temp, offset);
+    int32_t offset;
+    time_t next_transition;
+    if (TZRULES_NO_ZONE != s_zone[i] &&
+        !(s_rules_available && !s_zones_legacy && tzrules_offset(s_zone[i], now - s_utc_offset * 60, &offset, &next_transition))) {
+      return true;
+    }
+  }
+  return false;
+}
 
-    struct tm *tick_time = localtime(&temp);
+// Scrub window from the phone. For each configured timezone, little-endian: int16 offset
+// (minutes east of UTC) at the start of the window, uint8 transition count, then for each
+// transition uint32 time (minutes since the epoch, UTC) and int16 offset from then.
+static void load_scrub_window(const uint8_t *data, uint16_t length) {
+  s_scrub_window_requested = false;
+  
+  uint16_t at = 0;
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    if (at + 3 > length) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Scrub window too short: %u bytes", length);
+      return;
+    }
+    ScrubZone *zone = &s_scrub_zone[i];
+    zone->offset = (int16_t) (data[at] | (data[at + 1] << 8));
+    uint8_t count = data[at + 2];
+    at += 3;
     
-    s_popup_label_text[i][0] = '\0';
-    if (OFFSET_NO_DISPLAY == offset) {
-      s_popup_time[i][0] = '\0';
-    } else {
-      // Write the current hours and minutes into the buffer
-      if (clock_is_24h_style() == true) {
-        // Use 24 hour format
-        strftime(tt, sizeof("00:00"), "%H:%M", tick_time);
-      } else {
-        // Use 12 hour format
-        strftime(tt, sizeof("00:00"), "%I:%M", tick_time);
+    zone->count = 0;
+    for (int t = 0; t < count; t++, at += 6) {
+      if (at + 6 > length) {
+        APP_LOG(APP_LOG_LEVEL_WARNING, "Scrub window too short: %u bytes", length);
+        return;
       }
-
-      if (!s_offsets_up_to_date) {
-        strncat(s_popup_label_text[i], "?", 1);
+      if (zone->count < SCRUB_TRANSITIONS) {
+        zone->at[zone->count] = data[at] | (data[at + 1] << 8) | (data[at + 2] << 16) | ((uint32_t) data[at + 3] << 24);
+        zone->next_offset[zone->count] = (int16_t) (data[at + 4] | (data[at + 5] << 8));
+        zone->count++;
       }
-      strncat(s_popup_label_text[i], s_label[display], LABEL_SIZE - 1);
-      strncpy(s_popup_time[i], tt, sizeof(s_popup_time[i]));
     }
+  }
+  
+  s_scrub_window_valid = true;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Loaded scrub window, %u bytes", length);
+}
+
+// Render the popup times at the scrubbed hour. All computed on the watch, so scrubbing needs
+// no message per step: from the absolute offsets at that time if the UTC offset is known, or
+// else from the current offsets.
+static void update_scrub_time() {
+  time_t local = (time(NULL) / 3600 + s_scrub_hours) * 3600;
+  time_t utc = local - s_utc_offset * 60;
+  
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    int display = s_p_display[i];
+    int32_t offset;
+    
+    s_scrub_time[i][0] = '\0';
+    if (OFFSET_NO_DISPLAY != s_offset[display]) {
+      time_t t = (s_utc_offset_known && scrub_zone_offset(display, utc, &offset)) ?
+                 utc + offset * 60 : local + s_offset[display] * 60;
+      strftime(s_scrub_time[i], sizeof(s_scrub_time[i]), clock_is_24h_style() ? "%H:%M" : "%I:%M", localtime(&t));
+    }
+    text_layer_set_text(s_popup_time_layer[i], s_scrub_time[i]);
+  }
+}
 
-    text_layer_set_text(s_popup_label_layer[i], s_popup_label_text[i]);
-    text_layer_set_text(s_popup_time_layer[i], s_popup_time[i]);
+// Render the popup window from the time model, or at the scrubbed hour.
+static void update_popup_time() {
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "update_popup_time...");
+  update_labels();
+  
+  if (s_scrub_hours) {
+    update_scrub_time();
+    return;
+  }
+  
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    text_layer_set_text(s_popup_time_layer[i], s_model_time[s_p_display[i]]);
   }
 }
 
@@ -738,6 +1214,7 @@ static void create_layers() {
       d++;
     }
   }
+  set_main_labels();
 }
 
 /*
@@ -792,23 +1269,54 @@ static void delete_popup_layers() {
     delete_layer((Layer *) s_popup_label_layer[i]);
     delete_layer((Layer *) s_popup_time_layer[i]);
   }
+  delete_layer(s_popup_seconds_layer);
+  s_popup_seconds_layer = NULL;
+}
+
+// Draw the seconds against each displayed popup time.
+static void popup_seconds_update_proc(Layer *layer, GContext *ctx) {
+  GRect bounds = layer_get_bounds(layer);
+  s_seconds_stats.redraws++;
+  s_seconds_stats.redraw_area += bounds.size.w * bounds.size.h;
+
+  snprintf(s_popup_seconds_text, sizeof(s_popup_seconds_text), ":%02d", s_popup_second);
+  graphics_context_set_text_color(ctx, GColorWhite);
+  
+  int top = LAYER_TZ_SECONDS_TOP;
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    if (s_model_time[s_p_display[i]][0] != '\0') {
+      graphics_draw_text(ctx, s_popup_seconds_text, fonts_get_system_font(FONT_KEY_GOTHIC_18_BOLD),
+                         GRect(0, top, bounds.size.w, LAYER_TZ_HEIGHT - LAYER_TZ_SECONDS_TOP),
+                         GTextOverflowModeFill, GTextAlignmentLeft, NULL);
+    }
+    top += LAYER_TZ_HEIGHT;
+  }
 }
 
 static void create_popup_layers() {
   delete_popup_layers();
   
+  int label_width = popup_label_width();
   int top = 0;
   for (int i = 0; i < CONFIG_SIZE; i++) {
-    s_popup_label_layer[i] = create_text_layer(s_popup_window, GRect(0, top, LAYER_TZ_LABEL_WIDTH, LAYER_TZ_HEIGHT));
+    s_popup_label_layer[i] = create_text_layer(s_popup_window, GRect(0, top, label_width, LAYER_TZ_HEIGHT));
     text_layer_set_font(s_popup_label_layer[i], s_small_font);
     text_layer_set_text_alignment(s_popup_label_layer[i], GTextAlignmentLeft);
       
-    s_popup_time_layer[i] = create_text_layer(s_popup_window, GRect(LAYER_TZ_LABEL_WIDTH, top, LAYER_TZ_TIME_WIDTH, LAYER_TZ_HEIGHT));
+    s_popup_time_layer[i] = create_text_layer(s_popup_window, GRect(label_width, top, LAYER_TZ_TIME_WIDTH, LAYER_TZ_HEIGHT));
     text_layer_set_font(s_popup_time_layer[i], s_small_font);
     text_layer_set_text_alignment(s_popup_time_layer[i], GTextAlignmentRight);
       
     top += LAYER_TZ_HEIGHT;
   }
+
+  if (s_popup_seconds) {
+    // A single layer for the column, so that each second dirties only its area.
+    s_popup_seconds_layer = layer_create(GRect(label_width + LAYER_TZ_TIME_WIDTH, 0, LAYER_TZ_SECONDS_WIDTH, top));
+    layer_set_update_proc(s_popup_seconds_layer, popup_seconds_update_proc);
+    layer_add_child(window_get_root_layer(s_popup_window), s_popup_seconds_layer);
+  }
+  set_popup_labels();
 }
 
 static void popup_window_load(Window *window) {
@@ -819,54 +1327,233 @@ static void popup_window_unload(Window *window) {
   delete_popup_layers();
 }
 
+static void flush_updates(void *data) {
+  s_flush_timer_handle = NULL;
+
+  uint8_t dirty = s_dirty;
+  s_dirty = 0;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Flushing updates: %s%s",
+          (dirty & DIRTY_TIME) ? "time " : "", (dirty & DIRTY_STATUS) ? "status" : "");
+
+  if (dirty & DIRTY_TIME) {
+    update_time_model();
+    update_time();
+    if (2 == s_popup_state) {
+      update_popup_time();
+    }
+  }
+  if (dirty & DIRTY_STATUS) {
+    update_status();
+  }
+}
+
+// Record what has changed, and schedule a single update for the next event loop turn.
+static void mark_dirty(uint8_t flags) {
+  s_dirty |= flags;
+  if (!s_flush_timer_handle) {
+    s_flush_timer_handle = app_timer_register(0, flush_updates, NULL);
+  }
+}
+
 static void tick_handler(struct tm *tick_time, TimeUnits units_changed) {
-  update_time();
+  if (s_popup_seconds_active && s_popup_seconds_layer) {
+    // Only the seconds column changes, unless the minute has too
+    s_seconds_stats.wakeups++;
+    s_popup_second = tick_time->tm_sec;
+    layer_mark_dirty(s_popup_seconds_layer);
+  }
+  
+  if (units_changed & MINUTE_UNIT) {
+    s_activity.ticks++;
+    mark_dirty(DIRTY_TIME);
+  }
 }
 
-static void send_tz_request() {
-  DictionaryIterator *iter;
-  app_message_outbox_begin(&iter);
+static void log_seconds_stats() {
+  APP_LOG(APP_LOG_LEVEL_INFO, "Popup seconds: %lu wakeups, %lu redraws, %lu pixels redrawn (%d per redraw, screen %d)",
+          s_seconds_stats.wakeups, s_seconds_stats.redraws, s_seconds_stats.redraw_area,
+          LAYER_TZ_SECONDS_WIDTH * CONFIG_SIZE * LAYER_TZ_HEIGHT, 144 * 168);
+}
+
+// Tick every second while the popup shows seconds, otherwise every minute.
+static void set_popup_seconds_active(bool active) {
+  if (active == s_popup_seconds_active || (active && !s_popup_seconds_layer)) {
+    return;
+  }
   
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Requesting TZ offsets: %s, %s, %s, %s, %s, %s, %s, %s, ", s_tz[0], s_tz[1], s_tz[2], s_tz[3], s_tz[4], s_tz[5], s_tz[6], s_tz[7]);
+  s_popup_seconds_active = active;
+  if (active) {
+    s_popup_second = time(NULL) % 60;
+    tick_timer_service_subscribe(SECOND_UNIT, tick_handler);
+  } else {
+    tick_timer_service_subscribe(MINUTE_UNIT, tick_handler);
+    log_seconds_stats();
+  }
+}
 
-  // Add a key-value pair
-  dict_write_cstring(iter, KEY_TZ1, s_tz[0]);
-  dict_write_cstring(iter, KEY_TZ2, s_tz[1]);
-  dict_write_cstring(iter, KEY_TZ3, s_tz[2]);
-  dict_write_cstring(iter, KEY_TZ4, s_tz[3]);
-  dict_write_cstring(iter, KEY_TZ5, s_tz[4]);
-  dict_write_cstring(iter, KEY_TZ6, s_tz[5]);
-  dict_write_cstring(iter, KEY_TZ7, s_tz[6]);
-  dict_write_cstring(iter, KEY_TZ8, s_tz[7]);
+// Ask the phone for the offsets of the configured timezones. Returns whether the request was sent.
+static bool send_tz_request() {
+  DictionaryIterator *iter;
+  AppMessageResult r = app_message_outbox_begin(&iter);
+  if (r != APP_MSG_OK) {
+    // Probably another message still in flight, the caller tries again shortly.
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Cannot request TZ offsets: %d", r);
+    return false;
+  }
+  
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Requesting TZ offsets: %u, %u, %u, %u, %u, %u, %u, %u",
+          s_zone[0], s_zone[1], s_zone[2], s_zone[3], s_zone[4], s_zone[5], s_zone[6], s_zone[7]);
+
+  // Add a key-value pair, all zones are TZRULES_NO_ZONE while configured by name
+  // so the phone sends the configuration again, with IDs.
+  dict_write_data(iter, KEY_ZONES, (uint8_t *) s_zone, sizeof(s_zone));
+  if (s_zones_legacy) {
+    // Add the names too, for the phone to map to IDs even without a stored configuration.
+    char name[LEGACY_TZ_SIZE];
+    for (int i = 0; i < CONFIG_SIZE; i++) {
+      if (persist_read_string(KEY_LEGACY_TZ1 + i, name, sizeof(name)) > 0 && name[0] != '\0') {
+        dict_write_cstring(iter, KEY_LEGACY_TZ1 + i, name);
+      }
+    }
+  }
+  dict_write_end(iter);
 
   // Send the message!
-  app_message_outbox_send();
+  r = app_message_outbox_send();
+  if (r != APP_MSG_OK) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Cannot send TZ request: %d", r);
+    return false;
+  }
+
+  s_activity.requests++;
+  return true;
+}
+
+static void outbox_failed_callback(DictionaryIterator *failed, AppMessageResult reason, void *context) {
+  // Nothing to do: a failed TZ request leaves the offsets out of date, so it is repeated on a later
+  // tick, and the phone asks again for the battery log.
+  APP_LOG(APP_LOG_LEVEL_WARNING, "Message to the phone failed: %d", reason);
 }
 
 static void bluetooth_connection_callback(bool connected) {
-  update_status();
+  if (connected && (!s_offsets_up_to_date || s_offsets_provisional)) {
+    // The phone is back, ask it straight away rather than waiting for the backoff.
+    reset_request_backoff();
+    mark_dirty(DIRTY_TIME);
+  }
+  mark_dirty(DIRTY_STATUS);
 }
 
 static void popup_timer_callback(void *data) {
   APP_LOG(APP_LOG_LEVEL_DEBUG, "Popup timer callback: %d", s_popup_state);
+  set_popup_seconds_active(false);
   // State 0: do nothing, probably a race condition
   // State 1: Pending timed out, so return to state 0
-  if (2 == s_popup_state) {
-    // State 2: Close the window, return to state 0
+  if (2 == s_popup_state || 3 == s_popup_state) {
+    // State 2/3: Close the window, return to state 0
     window_stack_pop(true);
   }
   
   APP_LOG(APP_LOG_LEVEL_DEBUG, "Clearing popup state");
   s_popup_state = 0;
+  
+  // The next popup starts at now, with a fresh scrub window if needed.
+  s_scrub_hours = 0;
+  s_scrub_window_valid = false;
+  s_scrub_window_requested = false;
+  if (s_popup_seconds_layer) {
+    layer_set_hidden(s_popup_seconds_layer, false);
+  }
 
   set_status_text("");
-  update_status();
+  mark_dirty(DIRTY_STATUS);
+}
+
+static void send_transitions_request() {
+  DictionaryIterator *iter;
+  AppMessageResult r = app_message_outbox_begin(&iter);
+  if (r != APP_MSG_OK) {
+    // The next scrub step will try again
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Cannot request TZ transitions: %d", r);
+    return;
+  }
+  
+  dict_write_data(iter, KEY_ZONES, (uint8_t *) s_zone, sizeof(s_zone));
+  dict_write_uint8(iter, KEY_TRANSITIONS, SCRUB_WINDOW_DAYS);
+  dict_write_end(iter);
+  
+  app_message_outbox_send();
+  s_scrub_window_requested = true;
+}
+
+// Move the popup an hour ahead. Past the last scrub hour it wraps back to now, which closes it.
+static void scrub() {
+  if (s_scrub_hours >= SCRUB_HOURS) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Scrubbed round to now... closing.");
+    app_timer_cancel(s_popup_timer_handle);
+    popup_timer_callback(NULL);
+    return;
+  }
+  s_scrub_hours++;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Scrubbing to %d hours", s_scrub_hours);
+  
+  set_popup_seconds_active(false);
+  if (s_utc_offset_known && !s_scrub_window_valid && !s_scrub_window_requested && scrub_needs_window()) {
+    send_transitions_request();
+  }
+  if (s_popup_seconds_layer) {
+    layer_set_hidden(s_popup_seconds_layer, true);
+  }
+  update_popup_time();
+  
+  // Keep the popup open while scrubbing, it closes once the shakes stop
+  app_timer_reschedule(s_popup_timer_handle, POPUP_TIMEOUT_MS);
+}
+
+// Milliseconds since a time from time_ms(), up to a minute.
+static int32_t ms_since(time_t since_s, uint16_t since_ms) {
+  time_t now_s;
+  uint16_t now_ms;
+  time_ms(&now_s, &now_ms);
+  if (now_s - since_s > 60) {
+    return 60000;
+  }
+  return (now_s - since_s) * 1000 + now_ms - since_ms;
 }
 
 static void tap_handler(AccelAxisType axis, int32_t direction) {
+  // One shake can give several taps: only its first counts, however long it goes on.
+  bool burst = ms_since(s_last_tap_s, s_last_tap_ms) < TAP_BURST_MS;
+  time_ms(&s_last_tap_s, &s_last_tap_ms);
+  if (burst) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Same shake, ignoring tap");
+    return;
+  }
+  
   APP_LOG(APP_LOG_LEVEL_DEBUG, "Shake, oh shake the Pebble watch... state=%d", s_popup_state);
   if (2 == s_popup_state) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Popup already open... closing.");
+    if (ms_since(s_popup_opened_s, s_popup_opened_ms) < BATTERY_LOG_TAP_MS) {
+      APP_LOG(APP_LOG_LEVEL_DEBUG, "Popup just opened... showing battery log.");
+      s_popup_state = 3;
+      app_timer_cancel(s_popup_timer_handle);
+      set_popup_seconds_active(false);
+      
+      window_stack_pop(false);
+      window_stack_push(s_battery_window, false);
+      update_battery_log_text();
+      
+      s_popup_timer_handle = app_timer_register(POPUP_TIMEOUT_MS, popup_timer_callback, NULL);
+      return;
+    }
+    
+    // A watchface gets no buttons: later shakes scrub an hour ahead each, tap directions being unreliable.
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Popup open... scrubbing.");
+    scrub();
+    return;
+  }
+
+  if (3 == s_popup_state) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Battery log open... closing.");
     app_timer_cancel(s_popup_timer_handle);
     popup_timer_callback(NULL);
     return;
@@ -878,7 +1565,10 @@ static void tap_handler(AccelAxisType axis, int32_t direction) {
     app_timer_cancel(s_popup_timer_handle);
 
     update_popup_time();
+    set_popup_seconds_active(s_popup_seconds);
     window_stack_push(s_popup_window, true);
+    s_activity.popups++;
+    time_ms(&s_popup_opened_s, &s_popup_opened_ms);
   
     s_popup_timer_handle = app_timer_register(POPUP_TIMEOUT_MS, popup_timer_callback, NULL);
     return;
@@ -889,11 +1579,124 @@ static void tap_handler(AccelAxisType axis, int32_t direction) {
   s_popup_timer_handle = app_timer_register(POPUP_PENDING_TIMEOUT_MS, popup_timer_callback, NULL);
 
   set_status_text("*");
-  update_status();
+  mark_dirty(DIRTY_STATUS);
+}
+
+// Record the charge state if it has changed since the last record.
+static void record_battery_state(BatteryChargeState bcs) {
+  uint8_t flags = (bcs.is_plugged ? BATTERY_PLUGGED : 0) | (bcs.is_charging ? BATTERY_CHARGING : 0);
+  if (s_battery_log.count > 0) {
+    BatteryRecord *last = &s_battery_log.records[(s_battery_log.head + BATTERY_LOG_SIZE - 1) % BATTERY_LOG_SIZE];
+    if (last->percent == bcs.charge_percent && (last->flags & ~BATTERY_LOCAL_TIME) == flags) {
+      return;
+    }
+  }
+  
+  BatteryRecord *r = &s_battery_log.records[s_battery_log.head];
+  time_t now;
+  time(&now);
+  r->time = s_utc_offset_known ? now - s_utc_offset * 60 : now;
+  r->percent = bcs.charge_percent;
+  r->flags = flags | (s_utc_offset_known ? 0 : BATTERY_LOCAL_TIME);
+  r->ticks = s_activity.ticks;
+  r->requests = s_activity.requests;
+  r->popups = s_activity.popups;
+  memset(&s_activity, 0, sizeof(s_activity));
+  
+  s_battery_log.head = (s_battery_log.head + 1) % BATTERY_LOG_SIZE;
+  if (s_battery_log.count < BATTERY_LOG_SIZE) {
+    s_battery_log.count++;
+  }
+  
+  int s = persist_write_data(KEY_BATTERY_LOG, &s_battery_log, sizeof(s_battery_log));
+  if (s < 0) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Failed to remember battery log: %d", s);
+  }
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Battery log: %u%% %s", r->percent, bcs.is_plugged ? "plugged" : "");
+}
+
+// Get the i'th oldest battery record.
+static BatteryRecord *battery_record(int i) {
+  return &s_battery_log.records[(s_battery_log.head + BATTERY_LOG_SIZE - s_battery_log.count + i) % BATTERY_LOG_SIZE];
+}
+
+// Drain in tenths of a percent per hour over the latest unplugged run of records, -1 if unknown.
+static int32_t battery_drain() {
+  int newest = s_battery_log.count - 1;
+  if (newest < 1 || (battery_record(newest)->flags & BATTERY_PLUGGED)) {
+    return -1;
+  }
+  
+  int oldest = newest;
+  while (oldest > 0 && !(battery_record(oldest - 1)->flags & BATTERY_PLUGGED)) {
+    oldest--;
+  }
+  
+  int32_t seconds = battery_record(newest)->time - battery_record(oldest)->time;
+  if (seconds <= 0) {
+    return -1;
+  }
+  return (battery_record(oldest)->percent - battery_record(newest)->percent) * 36000 / seconds;
+}
+
+static void update_battery_log_text() {
+  char *p = s_battery_log_text;
+  char *end = s_battery_log_text + sizeof(s_battery_log_text);
+  
+  int32_t drain = battery_drain();
+  if (drain < 0) {
+    p += snprintf(p, end - p, "Drain: ?\n");
+  } else {
+    p += snprintf(p, end - p, "Drain: %d.%d%%/h\n", (int) (drain / 10), (int) (drain % 10));
+  }
+  
+  // Most recent records first, as many as fit on screen
+  for (int i = s_battery_log.count - 1; i >= 0 && i >= s_battery_log.count - BATTERY_LOG_LINES && p < end; i--) {
+    BatteryRecord *r = battery_record(i);
+    time_t t = (r->flags & BATTERY_LOCAL_TIME) ? r->time : r->time + s_utc_offset * 60;
+    char when[12];
+    strftime(when, sizeof(when), "%d %H:%M", localtime(&t));
+    p += snprintf(p, end - p, "%s %3u%%%s t%u r%u\n", when, r->percent,
+                  (r->flags & BATTERY_PLUGGED) ? "+" : " ", r->ticks, r->requests);
+  }
+  
+  text_layer_set_text(s_battery_log_layer, s_battery_log_text);
+}
+
+static void send_battery_log() {
+  DictionaryIterator *iter;
+  AppMessageResult r = app_message_outbox_begin(&iter);
+  if (r != APP_MSG_OK) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Cannot export battery log: %d", r);
+    return;
+  }
+  
+  // Oldest record first
+  BatteryRecord records[BATTERY_LOG_SIZE];
+  for (int i = 0; i < s_battery_log.count; i++) {
+    records[i] = *battery_record(i);
+  }
+  dict_write_data(iter, KEY_BATTERY_LOG, (uint8_t *) records, s_battery_log.count * sizeof(BatteryRecord));
+  dict_write_end(iter);
+  
+  app_message_outbox_send();
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Exported %d battery records", s_battery_log.count);
+}
+
+static void battery_window_load(Window *window) {
+  Layer *root = window_get_root_layer(window);
+  s_battery_log_layer = create_text_layer(window, layer_get_bounds(root));
+  text_layer_set_font(s_battery_log_layer, fonts_get_system_font(FONT_KEY_GOTHIC_14));
+}
+
+static void battery_window_unload(Window *window) {
+  delete_layer((Layer *) s_battery_log_layer);
+  s_battery_log_layer = NULL;
 }
 
 static void battery_state_handler(BatteryChargeState s) {
-  update_status();
+  record_battery_state(s);
+  mark_dirty(DIRTY_STATUS);
 }
 
 
@@ -909,6 +1712,14 @@ static void init() {
   window_set_background_color(s_popup_window, GColorBlack);
   popup_window_load(s_popup_window);
   
+  // Create battery log window
+  s_battery_window = window_create();
+  window_set_background_color(s_battery_window, GColorBlack);
+  window_set_window_handlers(s_battery_window, (WindowHandlers) {
+    .load = battery_window_load,
+    .unload = battery_window_unload
+  });
+  
   ResHandle big_handle = resource_get_handle(RESOURCE_ID_FONT_COMFORTAA_BOLD_33);
   s_big_font = fonts_load_custom_font(big_handle);
   
@@ -918,6 +1729,10 @@ static void init() {
   ResHandle small_handle = resource_get_handle(RESOURCE_ID_FONT_COMFORTAA_REGULAR_15);
   s_small_font = fonts_load_custom_font(small_handle);
   
+  s_label_measure_layer = text_layer_create(GRect(0, 0, LABEL_LAYOUT_WIDTH, LAYER_TZ_HEIGHT));
+  text_layer_set_font(s_label_measure_layer, s_small_font);
+  layer_set_hidden(text_layer_get_layer(s_label_measure_layer), true);
+  
   s_bmp_bt = gbitmap_create_with_resource(RESOURCE_ID_BMP_BT);
   s_bmp_nobt = gbitmap_create_with_resource(RESOURCE_ID_BMP_NOBT);
   s_bmp_charge = gbitmap_create_with_resource(RESOURCE_ID_BMP_CHARGE);
@@ -934,23 +1749,11 @@ static void init() {
   s_bmp_battery[9] = gbitmap_create_with_resource(RESOURCE_ID_BMP_90);
   
   // Read current TZ config
-  persist_read_string(KEY_TZ1, s_tz[0], TZ_SIZE);
-  persist_read_string(KEY_TZ2, s_tz[1], TZ_SIZE);
-  persist_read_string(KEY_TZ3, s_tz[2], TZ_SIZE);
-  persist_read_string(KEY_TZ4, s_tz[3], TZ_SIZE);
-  persist_read_string(KEY_TZ5, s_tz[4], TZ_SIZE);
-  persist_read_string(KEY_TZ6, s_tz[5], TZ_SIZE);
-  persist_read_string(KEY_TZ7, s_tz[6], TZ_SIZE);
-  persist_read_string(KEY_TZ8, s_tz[7], TZ_SIZE);
-  
-  s_offset[0] = persist_read_int(KEY_OFFSET1);
-  s_offset[1] = persist_read_int(KEY_OFFSET2);
-  s_offset[2] = persist_read_int(KEY_OFFSET3);
-  s_offset[3] = persist_read_int(KEY_OFFSET4);
-  s_offset[4] = persist_read_int(KEY_OFFSET5);
-  s_offset[5] = persist_read_int(KEY_OFFSET6);
-  s_offset[6] = persist_read_int(KEY_OFFSET7);
-  s_offset[7] = persist_read_int(KEY_OFFSET8);
+  if (persist_read_data(KEY_ZONES, s_zone, sizeof(s_zone)) != sizeof(s_zone)) {
+    memset(s_zone, 0, sizeof(s_zone));
+    s_zones_legacy = persist_exists(KEY_LEGACY_TZ1);
+  }
+  load_offsets();
   
   persist_read_string(KEY_LABEL1, s_label[0], LABEL_SIZE);
   persist_read_string(KEY_LABEL2, s_label[1], LABEL_SIZE);
@@ -961,21 +1764,34 @@ static void init() {
   persist_read_string(KEY_LABEL7, s_label[6], LABEL_SIZE);
   persist_read_string(KEY_LABEL8, s_label[7], LABEL_SIZE);
 
+  s_popup_seconds = persist_read_bool(KEY_POPUP_SECONDS);
+
+  if (persist_exists(KEY_UTC_OFFSET)) {
+    s_utc_offset = persist_read_int(KEY_UTC_OFFSET);
+    s_utc_offset_known = true;
+  }
+  load_offset_cache();
+  
+  if (persist_read_data(KEY_BATTERY_LOG, &s_battery_log, sizeof(s_battery_log)) != sizeof(s_battery_log)) {
+    memset(&s_battery_log, 0, sizeof(s_battery_log));
+  }
+  record_battery_state(battery_state_service_peek());
+  s_rules_available = tzrules_init();
+
   for (int i = 0; i < CONFIG_SIZE; i++) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Loaded TZ configuration 1: %s - %s (%ld)", s_label[i], s_tz[i], s_offset[i]);
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Loaded TZ configuration %d: %s - zone %u (%ld)", i + 1, s_label[i], s_zone[i], s_offset[i]);
   }
   
   sort_times();
   
   // Register a callback for the UTC offset information
-  // TODO register failure callbacks too
   app_message_register_inbox_received(inbox_received_callback);
+  app_message_register_outbox_failed(outbox_failed_callback);
   
-  // Connect to AppMessage stream
+  // Connect to AppMessage stream, the initial display update will request TZ offsets.
+  // The request may be sent before the phone is ready; the phone then answers when it
+  // becomes ready, with its last response if that still holds.
   app_message_open(app_message_inbox_size_maximum(), app_message_outbox_size_maximum());
-  
-  // Send a request for TZ offsets
-  send_tz_request();
 
   // Set handlers to manage the elements inside the Window
   window_set_window_handlers(s_main_window, (WindowHandlers) {
@@ -997,11 +1813,24 @@ static void init() {
   
   // Register for tap events
   accel_tap_service_subscribe(tap_handler);
+
+  // Draw the initial display
+  mark_dirty(DIRTY_TIME | DIRTY_STATUS);
 }
 
 static void deinit() {
+  if (s_flush_timer_handle) {
+    app_timer_cancel(s_flush_timer_handle);
+    s_flush_timer_handle = NULL;
+  }
+  if (s_request_timer_handle) {
+    app_timer_cancel(s_request_timer_handle);
+    s_request_timer_handle = NULL;
+  }
+  
   // Destroy Window
   window_destroy(s_main_window);
+  window_destroy(s_battery_window);
   
   accel_tap_service_unsubscribe();
   popup_window_unload(s_popup_window);
@@ -1012,6 +1841,9 @@ static void deinit() {
   if (s_medium_font) {
     fonts_unload_custom_font(s_medium_font);
   }
+  if (s_label_measure_layer) {
+    text_layer_destroy(s_label_measure_layer);
+  }
   if (s_small_font) {
     fonts_unload_custom_font(s_small_font);
   }
@@ -0,0 +1,104 @@
+#include <pebble.h>
+#include "tzrules.h"
+
+/*
+ * Resolve timezone offsets from the rules resource compiled from the
+ * moment-timezone data by tools/tzrules.py; see there for the layout.
+ * Only the parts needed for a lookup are read from the resource, the
+ * transitions a few at a time up to the one holding the time.
+ */
+
+#define TZRULES_HEADER_SIZE (8)
+#define TZRULES_ID_SIZE (2)
+#define TZRULES_ZONE_SIZE (4)
+#define TZRULES_TRANSITION_SIZE (6)
+
+// Transitions read from the resource at a time
+#define TZRULES_CHUNK (16)
+
+#define TZRULES_FOREVER (0xffffffff)
+#define TZRULES_NONE (0xffff)
+
+static ResHandle s_rules = NULL;
+static uint16_t s_id_count = 0;
+static uint16_t s_zone_count = 0;
+
+static uint16_t read_uint16(const uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t read_uint32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+bool tzrules_init() {
+  uint8_t header[TZRULES_HEADER_SIZE];
+  
+  s_rules = resource_get_handle(RESOURCE_ID_TZ_RULES);
+  if (resource_load_byte_range(s_rules, 0, header, sizeof(header)) != sizeof(header) ||
+      0 != memcmp(header, "TZR2", 4)) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Timezone rules not available");
+    s_rules = NULL;
+    return false;
+  }
+  
+  s_id_count = read_uint16(header + 4);
+  s_zone_count = read_uint16(header + 6);
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Timezone rules: %u IDs, %u zones", s_id_count, s_zone_count);
+  return true;
+}
+
+// Zone holding the transitions for the zone ID, -1 if none.
+static int find_zone(uint16_t zone_id) {
+  if (zone_id >= s_id_count) {
+    return -1;
+  }
+  
+  uint8_t entry[TZRULES_ID_SIZE];
+  resource_load_byte_range(s_rules, TZRULES_HEADER_SIZE + zone_id * TZRULES_ID_SIZE, entry, sizeof(entry));
+  uint16_t zone = read_uint16(entry);
+  return (TZRULES_NONE == zone) ? -1 : zone;
+}
+
+bool tzrules_offset(uint16_t zone_id, time_t utc, int32_t *offset, time_t *next_transition) {
+  uint8_t transitions[TZRULES_CHUNK * TZRULES_TRANSITION_SIZE];
+  
+  if (!s_rules || TZRULES_NO_ZONE == zone_id) {
+    return false;
+  }
+  
+  int zone = find_zone(zone_id);
+  if (zone < 0 || zone >= s_zone_count) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "No timezone rules for zone %u", zone_id);
+    return false;
+  }
+  
+  uint32_t zones_at = TZRULES_HEADER_SIZE + s_id_count * TZRULES_ID_SIZE;
+  uint8_t entry[TZRULES_ZONE_SIZE];
+  resource_load_byte_range(s_rules, zones_at + zone * TZRULES_ZONE_SIZE, entry, sizeof(entry));
+  uint16_t first = read_uint16(entry);
+  uint16_t count = read_uint16(entry + 2);
+  
+  // As moment-timezone: the first transition still in the future holds the current offset.
+  uint32_t transitions_at = zones_at + s_zone_count * TZRULES_ZONE_SIZE + first * TZRULES_TRANSITION_SIZE;
+  uint32_t minutes = utc / 60;
+  for (int i = 0; i < count; i += TZRULES_CHUNK) {
+    int chunk = (count - i < TZRULES_CHUNK) ? count - i : TZRULES_CHUNK;
+    if (resource_load_byte_range(s_rules, transitions_at + i * TZRULES_TRANSITION_SIZE, transitions,
+                                 chunk * TZRULES_TRANSITION_SIZE) != (size_t) (chunk * TZRULES_TRANSITION_SIZE)) {
+      return false;
+    }
+    
+    for (int j = 0; j < chunk; j++) {
+      const uint8_t *t = transitions + j * TZRULES_TRANSITION_SIZE;
+      uint32_t until = read_uint32(t);
+      if (minutes < until || i + j == count - 1) {
+        *offset = (int16_t) read_uint16(t + 4);
+        *next_transition = (TZRULES_FOREVER == until) ? 0 : (time_t) until * 60;
+        return true;
+      }
+    }
+  }
+  
+  return false;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <pebble.h>
+
+// Zone ID for no timezone. IDs are assigned by tools/tzrules.py, and shared with the phone.
+#define TZRULES_NO_ZONE (0)
+
+// Open the compiled timezone rules resource, returns false if it is unusable.
+bool tzrules_init();
+
+// Look up the offset (minutes east of UTC) of a timezone, by ID, at a UTC time.
+// Sets next_transition to the UTC time the offset next changes, or 0 if it never does.
+// Returns false if the zone is unknown. Beyond the last transition in the data the
+// last offset holds for ever, as it does on the phone.
+bool tzrules_offset(uint16_t zone_id, time_t utc, int32_t *offset, time_t *next_transition);
@@ -3810,6 +3810,250 @@
 
 ///////////////////////////////
 
+// Zone name index: sorted search tokens (full names, city names and their
+// words) for fast prefix search, and the canonical zone for every name and alias.
+var zoneIndex = null;
+
+function buildZoneIndex() {
+  var tokens = [];
+  var canonical = {};
+  var groups = [];
+
+  // Aliases share their unpacked data with the zone they link to, and are
+  // added after it, so the first zone seen for any data is the canonical one.
+  for (var key in tz._zones) {
+    var zone = tz._zones[key];
+    if (!zone) {
+      continue;
+    }
+
+    var name = zone.name;
+    var canon = name;
+    for (var g = 0; g < groups.length; g++) {
+      if (groups[g].untils === zone.untils) {
+        canon = groups[g].name;
+        break;
+      }
+    }
+    if (canon === name) {
+      groups.push(zone);
+    }
+    canonical[name.toLowerCase()] = canon;
+
+    var lower = name.toLowerCase();
+    var parts = lower.split("/");
+    var city = parts[parts.length - 1];
+    var alias = canon !== name;
+    tokens.push({ token: lower, name: name, canonical: canon, rank: alias ? 2 : 0 });
+    if (parts.length > 1) {
+      tokens.push({ token: city.replace(/_/g, " "), name: name, canonical: canon, rank: alias ? 3 : 1 });
+      var words = city.split("_");
+      for (var w = 1; w < words.length; w++) {
+        tokens.push({ token: words[w], name: name, canonical: canon, rank: alias ? 5 : 4 });
+      }
+    }
+  }
+
+  tokens.sort(function (a, b) {
+    return a.token < b.token ? -1 : (a.token > b.token ? 1 : a.rank - b.rank);
+  });
+
+  zoneIndex = { tokens: tokens, canonical: canonical };
+  console.log("Built zone index: " + tokens.length + " tokens");
+}
+
+// Canonical zone name for a zone or alias, null if unknown.
+function canonicalZone(name) {
+  if (zoneIndex === null) {
+    buildZoneIndex();
+  }
+  return zoneIndex.canonical[(name || "").toLowerCase()] || null;
+}
+
+// Ranked zones matching a prefix of a zone or city name, with aliases
+// resolved so each canonical zone appears at most once.
+function searchZones(query, limit) {
+  if (zoneIndex === null) {
+    buildZoneIndex();
+  }
+  var q = (query || "").toLowerCase().replace(/^\s+|\s+$/g, "");
+  var tokens = zoneIndex.tokens;
+  limit = limit || 10;
+  if (q === "") {
+    return [];
+  }
+
+  // Binary search for the first token not before the query.
+  var lo = 0, hi = tokens.length;
+  while (lo < hi) {
+    var mid = (lo + hi) >> 1;
+    if (tokens[mid].token < q) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  var matches = [];
+  for (var i = lo; i < tokens.length && tokens[i].token.lastIndexOf(q, 0) === 0; i++) {
+    var t = tokens[i];
+    matches.push({ name: t.name, canonical: t.canonical, rank: t.rank + (t.token === q ? 0 : 10), token: t.token });
+  }
+  matches.sort(function (a, b) {
+    return a.rank - b.rank || a.token.length - b.token.length || (a.name < b.name ? -1 : 1);
+  });
+
+  var seen = {};
+  var results = [];
+  for (var m = 0; m < matches.length && results.length < limit; m++) {
+    if (!seen[matches[m].canonical]) {
+      seen[matches[m].canonical] = true;
+      results.push({ name: matches[m].name, canonical: matches[m].canonical });
+    }
+  }
+  return results;
+}
+
+// Resolve a configured zone or alias to its canonical name. An unknown name is left as is,
+// without an ID, rather than guessed from a search: the user did not pick the match.
+function resolveZone(name) {
+  if (!name) {
+    return name;
+  }
+  var canon = canonicalZone(name);
+  if (canon === null) {
+    console.log("Unknown zone " + name);
+    return name;
+  }
+  if (canon !== name) {
+    console.log("Resolved zone " + name + " to " + canon);
+  }
+  return canon;
+}
+
+// Outbound message queue: one message in flight at a time, each waiting for its
+// ack, retried with backoff on nack. Queuing a message of a given kind drops any
+// older unsent one of the same kind, so only the newest offsets reach the watch.
+var OUTBOX_RETRIES = 5;
+var OUTBOX_BACKOFF_MS = 500;
+var outbox = [];
+var outboxBusy = false;
+
+function queueMessage(kind, message) {
+  for (var i = outbox.length - 1; i >= (outboxBusy ? 1 : 0); i--) {
+    if (outbox[i].kind === kind) {
+      console.log("Dropping superseded " + kind + " message");
+      outbox.splice(i, 1);
+    }
+  }
+  outbox.push({ kind: kind, message: message, attempts: 0 });
+  sendNextMessage();
+}
+
+function isSuperseded(item) {
+  for (var i = outbox.indexOf(item) + 1; i < outbox.length; i++) {
+    if (outbox[i].kind === item.kind) {
+      return true;
+    }
+  }
+  return false;
+}
+
+function sendNextMessage() {
+  if (outboxBusy || outbox.length === 0) {
+    return;
+  }
+
+  var item = outbox[0];
+  item.attempts++;
+  outboxBusy = true;
+  Pebble.sendAppMessage(item.message,
+    function(e) {
+      console.log("Sent " + item.kind + " message");
+      outbox.shift();
+      outboxBusy = false;
+      sendNextMessage();
+    },
+    function(e) {
+      outboxBusy = false;
+      if (isSuperseded(item)) {
+        console.log("Dropping superseded " + item.kind + " message");
+        outbox.shift();
+        sendNextMessage();
+      } else if (item.attempts >= OUTBOX_RETRIES) {
+        console.log("Giving up on " + item.kind + " message after " + item.attempts + " attempts");
+        outbox.shift();
+        sendNextMessage();
+      } else {
+        console.log("Failed to send " + item.kind + " message, retrying");
+        setTimeout(sendNextMessage, OUTBOX_BACKOFF_MS * Math.pow(2, item.attempts - 1));
+      }
+    }
+  );
+}
+
+// Number of timezones configured on the watch.
+var CONFIG_SIZE = 8;
+
+// Zone IDs shared with the watch (see zoneids.js), by lower case name.
+var zoneIds = null;
+
+function zoneId(name) {
+  if (zoneIds === null) {
+    zoneIds = {};
+    for (var i = 1; i < ZONE_IDS.length; i++) {
+      zoneIds[ZONE_IDS[i].toLowerCase()] = i;
+    }
+  }
+  return zoneIds[(name || "").toLowerCase()] || 0;
+}
+
+function zoneName(id) {
+  return ZONE_IDS[id] || "";
+}
+
+// Zones and offsets travel as byte arrays of little-endian 16-bit values.
+function pack16(values) {
+  var bytes = [];
+  for (var i = 0; i < values.length; i++) {
+    bytes.push(values[i] & 0xff, (values[i] >> 8) & 0xff);
+  }
+  return bytes;
+}
+
+function unpackUint16(bytes) {
+  var values = [];
+  for (var i = 0; i + 1 < bytes.length; i += 2) {
+    values.push(bytes[i] | (bytes[i + 1] << 8));
+  }
+  return values;
+}
+
+// Configuration message for the watch, with zones resolved to their IDs.
+function configMessage(configuration) {
+  var ids = [];
+  for (var i = 1; i <= CONFIG_SIZE; i++) {
+    var name = resolveZone(configuration["tz" + i]);
+    var id = zoneId(name);
+    if (name && id === 0) {
+      console.log("No ID for zone " + name);
+    }
+    ids.push(id);
+  }
+  return {"zones": pack16(ids), "l1": configuration.l1, "l2": configuration.l2, "l3": configuration.l3, "l4": configuration.l4, "l5": configuration.l5, "l6": configuration.l6, "l7": configuration.l7, "l8": configuration.l8, "seconds": Number(configuration.seconds) === 1 ? 1 : 0 };
+}
+
+// Configuration as last returned by the configuration page.
+function storedConfiguration() {
+  var configuration = {};
+  for (var i = 1; i <= CONFIG_SIZE; i++) {
+    configuration["tz" + i] = window.localStorage.getItem("tz" + i) || "";
+    configuration["l" + i] = window.localStorage.getItem("l" + i) || "";
+  }
+  configuration.seconds = window.localStorage.getItem("seconds");
+  return configuration;
+}
+
 function offset(t) {
   if (t === "") {
     return -2000;
@@ -3819,16 +4063,184 @@ function offset(t) {
   return tzLocal.zone() - tzRemote.zone();
 }
 
+// The last response is kept so that it can be replayed as soon as the watch
+// connects, without waiting for the watch's request or for moment.
+var LAST_RESPONSE_KEY = "_lastoffsets";
+var LAST_RESPONSE_MAX_AGE_MS = 24 * 60 * 60 * 1000;
+
+// Earliest instant (ms since the epoch) at which any of the given zones
+// next changes its offset.
+function nextTransition(tzs, now) {
+  var next = now + LAST_RESPONSE_MAX_AGE_MS;
+  for (var i = 0; i < tzs.length; i++) {
+    var zone = tzs[i] ? tz.zone(tzs[i]) : null;
+    if (!zone) {
+      continue;
+    }
+    for (var j = 0; j < zone.untils.length; j++) {
+      if (zone.untils[j] > now) {
+        next = Math.min(next, zone.untils[j]);
+        break;
+      }
+    }
+  }
+  return next;
+}
+
+function saveLastResponse(tzs, response) {
+  var now = Date.now();
+  var saved = { validUntil: nextTransition(tzs, now), zone: new Date(now).getTimezoneOffset(), response: response };
+  window.localStorage.setItem(LAST_RESPONSE_KEY, JSON.stringify(saved));
+}
+
+// The last response, if no zone it covers, nor the phone's own zone, has
+// changed offset since it was computed.
+function loadLastResponse() {
+  var saved = window.localStorage.getItem(LAST_RESPONSE_KEY);
+  if (!saved) {
+    return null;
+  }
+  try {
+    saved = JSON.parse(saved);
+  } catch (err) {
+    return null;
+  }
+  var now = Date.now();
+  if (now >= saved.validUntil || new Date(now).getTimezoneOffset() !== saved.zone) {
+    return null;
+  }
+  return saved.response;
+}
+
 function processTimezones(payload) {
-  console.log("Received TZ request: " + [payload.tz1, payload.tz2, payload.tz3, payload.tz4, payload.tz5, payload.tz6, payload.tz7, payload.tz8]);
-  var response = { offset1: offset(payload.tz1), offset2: offset(payload.tz2), offset3: offset(payload.tz3), offset4: offset(payload.tz4), offset5: offset(payload.tz5), offset6: offset(payload.tz6), offset7: offset(payload.tz7), offset8: offset(payload.tz8) };
-  Pebble.sendAppMessage(response);
-  console.log("Response: " + response);
+  var ids = unpackUint16(payload.zones || []);
+  var tzs = [];
+  for (var i = 0; i < CONFIG_SIZE; i++) {
+    tzs.push(zoneName(ids[i]));
+  }
+  console.log("Received TZ request: " + tzs);
+
+  if (tzs.join("") === "") {
+    // A watch configured by name, by an earlier version, has no zone IDs yet: send them,
+    // and it will ask again. It sends its names, which only need mapping to IDs, as its
+    // labels are already set; otherwise fall back to the stored configuration.
+    var names = {};
+    var named = false;
+    for (var k = 1; k <= CONFIG_SIZE; k++) {
+      names["tz" + k] = payload["tz" + k] || "";
+      named = named || names["tz" + k] !== "";
+    }
+    var config = named ? {"zones": configMessage(names).zones} : configMessage(storedConfiguration());
+    if (unpackUint16(config.zones).some(function (id) { return id !== 0; })) {
+      console.log("Sending zone IDs for the " + (named ? "watch's" : "stored") + " configuration");
+      // Zones alone must not supersede a full configuration still queued, nor the other way round.
+      queueMessage(named ? "zones" : "config", config);
+      return;
+    }
+  }
+
+  sendOffsets(tzs);
+}
+
+// Send the watch the offsets of the given zones, and remember them for the next start.
+function sendOffsets(tzs) {
+  var offsets = [];
+  for (var j = 0; j < CONFIG_SIZE; j++) {
+    offsets.push(offset(tzs[j]));
+  }
+  var response = { offsets: pack16(offsets), utcoffset: -moment().zone() };
+  queueMessage("offsets", response);
+  saveLastResponse(tzs, response);
+  console.log("Response: " + offsets + ", UTC offset " + response.utcoffset);
+}
+
+// Zones of the stored configuration, as the watch knows them by ID.
+function storedZones() {
+  var configuration = storedConfiguration();
+  var tzs = [];
+  for (var i = 1; i <= CONFIG_SIZE; i++) {
+    tzs.push(zoneName(zoneId(resolveZone(configuration["tz" + i]))));
+  }
+  return tzs;
+}
+
+// Offsets of the requested zones over a window either side of now, so the watch can
+// scrub through time without asking for each step. For each zone, little-endian:
+// int16 offset (minutes east of UTC) at the window start, uint8 transition count,
+// then for each transition uint32 time (minutes since the epoch, UTC) and int16 offset.
+function processTransitions(payload) {
+  var ids = unpackUint16(payload.zones || []);
+  var now = Date.now();
+  var span = (payload.transitions || 7) * 24 * 60 * 60 * 1000 + 60 * 60 * 1000;
+  var bytes = [];
+  for (var i = 0; i < CONFIG_SIZE; i++) {
+    var zone = ids[i] ? tz.zone(zoneName(ids[i])) : null;
+    if (!zone) {
+      bytes = bytes.concat(pack16([-2000]), [0]);
+      continue;
+    }
+
+    // moment offsets are minutes west, each holding until the matching until
+    var j = 0;
+    while (j < zone.untils.length - 1 && zone.untils[j] <= now - span) {
+      j++;
+    }
+    var header = bytes.length;
+    bytes = bytes.concat(pack16([-zone.offsets[j]]), [0]);
+    for (; j < zone.untils.length - 1 && zone.untils[j] < now + span; j++) {
+      var at = Math.round(zone.untils[j] / 60000);
+      bytes.push(at & 0xff, (at >>> 8) & 0xff, (at >>> 16) & 0xff, (at >>> 24) & 0xff);
+      bytes = bytes.concat(pack16([-zone.offsets[j + 1]]));
+      bytes[header + 2]++;
+    }
+  }
+  console.log("Transitions for " + ids + ": " + bytes.length + " bytes");
+  queueMessage("transitions", {"transitions": bytes});
+}
+
+// Battery log records exported by the watch are 12 bytes, little-endian:
+// uint32 time, uint8 percent, uint8 flags, uint16 ticks, uint16 requests, uint16 popups.
+// The time is UTC, unless flagged (4) as the watch's local time, taken to be the phone's.
+var BATTERY_RECORD_SIZE = 12;
+var BATTERY_HISTORY_SIZE = 200;
+
+function processBatteryLog(bytes) {
+  var u16 = function (i) { return bytes[i] | (bytes[i + 1] << 8); };
+  var history = JSON.parse(window.localStorage.getItem("_batterylog") || "[]");
+  var latest = history.length > 0 ? history[history.length - 1].time : 0;
+
+  var localOffset = new Date().getTimezoneOffset() * 60;
+
+  for (var i = 0; i + BATTERY_RECORD_SIZE <= bytes.length; i += BATTERY_RECORD_SIZE) {
+    var time = (bytes[i] | (bytes[i + 1] << 8) | (bytes[i + 2] << 16)) + bytes[i + 3] * 16777216;
+    var record = {
+      time: (bytes[i + 5] & 4) !== 0 ? time + localOffset : time,
+      percent: bytes[i + 4],
+      plugged: (bytes[i + 5] & 1) !== 0,
+      charging: (bytes[i + 5] & 2) !== 0,
+      ticks: u16(i + 6),
+      requests: u16(i + 8),
+      popups: u16(i + 10)
+    };
+    if (record.time > latest) {
+      history.push(record);
+    }
+  }
+
+  history = history.slice(-BATTERY_HISTORY_SIZE);
+  window.localStorage.setItem("_batterylog", JSON.stringify(history));
+  console.log("Battery log: " + history.length + " records, latest " + JSON.stringify(history[history.length - 1]));
 }
 
 Pebble.addEventListener("appmessage",
   function (e) {
-    processTimezones(e.payload);
+    if (e.payload.batterylog !== undefined) {
+      processBatteryLog(e.payload.batterylog);
+    } else if (e.payload.transitions !== undefined) {
+      processTransitions(e.payload);
+    } else {
+      processTimezones(e.payload);
+    }
   }
 );
 
@@ -3838,7 +4250,8 @@ Pebble.addEventListener("showConfiguration",
     for (var i = 0, x = window.localStorage.length; i < x; i++) {
       var key = window.localStorage.key(i);
       var val = window.localStorage.getItem(key);
-      if (val !== null) {
+      // Keys starting with _ are internal to this script, not configuration
+      if (val !== null && key.charAt(0) !== "_") {
         url += "&" + encodeURIComponent(key) + "=" + encodeURIComponent(val);
       }
     }
@@ -3857,17 +4270,12 @@ Pebble.addEventListener("webviewclosed",
     for (var key in configuration) {
       window.localStorage.setItem(key, configuration[key]);
     }
+
+    // The last response was for the old zones
+    window.localStorage.removeItem(LAST_RESPONSE_KEY);
      
-    // Send to Pebble, persist there
-    Pebble.sendAppMessage(
-      {"tz1": configuration.tz1, "tz2": configuration.tz2, "tz3": configuration.tz3, "tz4": configuration.tz4, "tz5": configuration.tz5, "tz6": configuration.tz6, "tz7": configuration.tz7, "tz8": configuration.tz8, "l1": configuration.l1, "l2": configuration.l2, "l3": configuration.l3, "l4": configuration.l4, "l5": configuration.l5, "l6": configuration.l6, "l7": configuration.l7, "l8": configuration.l8 },
-      function(e) {
-        console.log("Sending settings data...");
-      },
-      function(e) {
-        console.log("Settings feedback failed!");
-      }
-    );
+    // Send to Pebble, persist there, using zone IDs
+    queueMessage("config", configMessage(configuration));
   }
 );
 
@@ -3875,5 +4283,21 @@ Pebble.addEventListener("ready",
   function(e) {
     "use strict";
     console.log("Pebble JS ready");
+
+    // Answer the watch's startup request straight away, with the last answer if
+    // it still holds, or else fresh offsets for the stored configuration. The
+    // request itself may have been sent before we were ready.
+    var last = loadLastResponse();
+    var tzs = last ? null : storedZones();
+    if (last) {
+      console.log("Replaying last response: " + JSON.stringify(last));
+      queueMessage("offsets", last);
+    } else if (tzs.join("") !== "") {
+      console.log("No last response, sending offsets for the stored configuration");
+      sendOffsets(tzs);
+    }
+
+    // Collect the watch's battery log
+    queueMessage("batterylog", {"batterylog": 1});
   }
 );
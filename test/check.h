@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+ * Checks of the watch against the moment-timezone reference, for the programs
+ * that include src/main.c. Configured zones are given by name, and are persisted
+ * as the watch would have them from an earlier configuration.
+ */
+
+// Reference HH:MM in a zone at the current simulated time.
+static void reference_time(const char *zone, char *text, size_t size) {
+  time_t t = host_now() / 1000 + host_zone_offset(zone, host_now()) * 60;
+  strftime(text, size, "%H:%M", gmtime(&t));
+}
+
+// Persist a configuration of the given zones (NULL for none), with offsets as the
+// phone would have sent them at the given time.
+static void persist_configuration(const char *zones[CONFIG_SIZE], host_ms_t when) {
+  uint16_t zone[CONFIG_SIZE];
+  int16_t offset[CONFIG_SIZE];
+  int32_t utc_offset = host_zone_offset(host_local_zone(), when);
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    zone[i] = zones[i] ? host_zone_id(zones[i]) : TZRULES_NO_ZONE;
+    offset[i] = zones[i] ? host_zone_offset(zones[i], when) - utc_offset : OFFSET_NO_DISPLAY;
+    persist_write_string(KEY_LABEL1 + i, zones[i] ? strchr(zones[i], '/') + 1 : "");
+  }
+  persist_write_data(KEY_ZONES, zone, sizeof(zone));
+  persist_write_data(KEY_OFFSETS, offset, sizeof(offset));
+  persist_write_int(KEY_UTC_OFFSET, utc_offset);
+}
+
+// Whether the main window shows every configured zone, and the right time on every row.
+// If not, says why in error. For at most four zones, none with the local time.
+static bool display_correct(const char *zones[CONFIG_SIZE], char *error, size_t size) {
+  char expected[sizeof("00:00")];
+  int configured = 0;
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    configured += zones[i] ? 1 : 0;
+  }
+
+  int d = 0;
+  for (int i = 0; i < s_num_display; i++) {
+    int display = s_display[i];
+    TextLayer *layer = (DISPLAY_LOCAL_TIME == display) ? s_local_time_layer : s_tz_time_layer[d++];
+    const char *zone = (DISPLAY_LOCAL_TIME == display) ? host_local_zone() : zones[display];
+    if (!zone) {
+      snprintf(error, size, "row %d shows unconfigured timezone %d", i, display + 1);
+      return false;
+    }
+
+    reference_time(zone, expected, sizeof(expected));
+    const char *shown = host_layer_text(layer);
+    if (!shown || 0 != strcmp(shown, expected)) {
+      snprintf(error, size, "%s shows %s, expected %s", zone, shown ? shown : "nothing", expected);
+      return false;
+    }
+  }
+
+  if (d != configured) {
+    snprintf(error, size, "%d of %d timezones shown", d, configured);
+    return false;
+  }
+  return true;
+}
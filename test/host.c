@@ -0,0 +1,1285 @@
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "host.h"
+
+/*
+ * Simulated watch for the host harness: everything the watch code sees of the
+ * SDK, run from a single event queue in simulated time. The phone side is the
+ * real phone JS under Node (phone.js), driven over a pipe, one command at a
+ * time, with its clock and timers following the simulation.
+ *
+ * Environment: HOST_LOG=1 prints the watch and phone logs (2 includes debug),
+ * HOST_SEED seeds the link's drops and busy refusals.
+ */
+
+HostLink host_link = { .latency_ms = 100, .timeout_ms = 3000, .drop_percent = 0, .busy_percent = 0, .connected = true };
+HostStats host_stats;
+void (*host_after_event)(void) = NULL;
+
+static host_ms_t s_now = 0;
+static const char *s_local_zone = "UTC";
+static int s_log_level = 0;
+static uint32_t s_random = 2463534242u;
+
+static uint32_t host_random(void) {
+  s_random ^= s_random << 13;
+  s_random ^= s_random >> 17;
+  s_random ^= s_random << 5;
+  return s_random;
+}
+
+static bool host_chance(uint8_t percent) {
+  return percent && host_random() % 100 < percent;
+}
+
+void host_reset_stats(void) {
+  memset(&host_stats, 0, sizeof(host_stats));
+}
+
+host_ms_t host_now(void) {
+  return s_now;
+}
+
+void app_log(uint8_t level, const char *filename, int line, const char *fmt, ...) {
+  if (s_log_level == 0 || (s_log_level == 1 && level > APP_LOG_LEVEL_INFO)) {
+    return;
+  }
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "[%lld watch] %s:%d ", (long long) s_now, filename, line);
+  vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  va_end(args);
+}
+
+/*
+ * Event queue: a binary heap ordered by time, then by when the event was queued.
+ */
+
+typedef enum {
+  EVENT_TICK,
+  EVENT_TIMER,
+  EVENT_TO_PHONE,
+  EVENT_TO_WATCH,
+  EVENT_WATCH_RESULT,
+  EVENT_PHONE_RESULT,
+  EVENT_PHONE_TIMER
+} EventType;
+
+typedef struct {
+  host_ms_t when;
+  uint64_t seq;
+  EventType type;
+  uint32_t generation;
+  void *data;
+  int32_t value;
+} Event;
+
+static Event *s_events = NULL;
+static size_t s_event_count = 0;
+static size_t s_event_capacity = 0;
+static uint64_t s_event_seq = 0;
+
+static bool event_before(const Event *a, const Event *b) {
+  return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+static void queue_event(host_ms_t when, EventType type, uint32_t generation, void *data, int32_t value) {
+  if (s_event_count == s_event_capacity) {
+    s_event_capacity = s_event_capacity ? 2 * s_event_capacity : 64;
+    s_events = realloc(s_events, s_event_capacity * sizeof(Event));
+  }
+  size_t i = s_event_count++;
+  Event e = { when, s_event_seq++, type, generation, data, value };
+  while (i > 0 && event_before(&e, &s_events[(i - 1) / 2])) {
+    s_events[i] = s_events[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  s_events[i] = e;
+}
+
+static Event pop_event(void) {
+  Event top = s_events[0];
+  Event last = s_events[--s_event_count];
+  size_t i = 0;
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= s_event_count) {
+      break;
+    }
+    if (child + 1 < s_event_count && event_before(&s_events[child + 1], &s_events[child])) {
+      child++;
+    }
+    if (!event_before(&s_events[child], &last)) {
+      break;
+    }
+    s_events[i] = s_events[child];
+    i = child;
+  }
+  s_events[i] = last;
+  return top;
+}
+
+/*
+ * Phone: phone.js under Node, one command per line, each answered by any
+ * messages the phone JS sent and its next timer ("next <ms>", -1 for none).
+ */
+
+static FILE *s_phone_in = NULL;
+static FILE *s_phone_out = NULL;
+static pid_t s_phone_pid = 0;
+static bool s_phone_ready = false;
+static uint32_t s_phone_timer_generation = 0;
+static host_ms_t s_phone_timer = -1;
+
+struct DictionaryIterator {
+  int count;
+  Tuple *tuples[32];
+  uint32_t id;
+  uint32_t capacity;
+};
+
+static void dict_clear(DictionaryIterator *iter) {
+  for (int i = 0; i < iter->count; i++) {
+    free(iter->tuples[i]);
+  }
+  iter->count = 0;
+}
+
+static DictionaryIterator *dict_copy(const DictionaryIterator *iter) {
+  DictionaryIterator *copy = calloc(1, sizeof(DictionaryIterator));
+  *copy = *iter;
+  for (int i = 0; i < iter->count; i++) {
+    size_t size = sizeof(Tuple) + iter->tuples[i]->length + 1;
+    copy->tuples[i] = malloc(size);
+    memcpy(copy->tuples[i], iter->tuples[i], size);
+  }
+  return copy;
+}
+
+static void dict_free(DictionaryIterator *iter) {
+  dict_clear(iter);
+  free(iter);
+}
+
+static int dict_add(DictionaryIterator *iter, uint32_t key, TupleType type, const void *data, uint16_t length) {
+  if (iter->count == (int) (sizeof(iter->tuples) / sizeof(iter->tuples[0])) ||
+      (iter->capacity && dict_write_end(iter) + 7 + length > iter->capacity)) {
+    return 2;  // DICT_NOT_ENOUGH_STORAGE
+  }
+  Tuple *t = calloc(1, sizeof(Tuple) + length + 1);
+  t->key = key;
+  t->type = type;
+  t->length = length;
+  memcpy(t->value->data, data, length);
+  iter->tuples[iter->count++] = t;
+  return 0;
+}
+
+// Tuples on the phone pipe: key:type:value, type b (hex bytes), s (hex string) or i (integer).
+static void write_tuples(FILE *out, const DictionaryIterator *iter) {
+  for (int i = 0; i < iter->count; i++) {
+    const Tuple *t = iter->tuples[i];
+    if (TUPLE_BYTE_ARRAY == t->type || TUPLE_CSTRING == t->type) {
+      uint16_t length = t->length;
+      if (TUPLE_CSTRING == t->type && length > 0 && t->value->cstring[length - 1] == '\0') {
+        length--;
+      }
+      fprintf(out, " %u:%c:", t->key, TUPLE_BYTE_ARRAY == t->type ? 'b' : 's');
+      for (int j = 0; j < length; j++) {
+        fprintf(out, "%02x", t->value->data[j]);
+      }
+    } else {
+      int32_t v = (1 == t->length) ? (TUPLE_INT == t->type ? t->value->int8 : t->value->uint8) : t->value->int32;
+      fprintf(out, " %u:i:%d", t->key, v);
+    }
+  }
+}
+
+static void read_tuples(DictionaryIterator *iter, char *text) {
+  for (char *field = strtok(text, " \n"); field; field = strtok(NULL, " \n")) {
+    uint32_t key = strtoul(field, &field, 10);
+    char type = field[1];
+    char *value = field + 3;
+    if ('i' == type) {
+      int32_t v = strtol(value, NULL, 10);
+      dict_add(iter, key, TUPLE_INT, &v, sizeof(v));
+    } else {
+      uint8_t bytes[1024];
+      uint16_t length = 0;
+      for (; value[0] && value[1] && length < sizeof(bytes) - 1; value += 2) {
+        unsigned byte;
+        sscanf(value, "%2x", &byte);
+        bytes[length++] = byte;
+      }
+      if ('s' == type) {
+        bytes[length++] = '\0';
+      }
+      dict_add(iter, key, 's' == type ? TUPLE_CSTRING : TUPLE_BYTE_ARRAY, bytes, length);
+    }
+  }
+}
+
+static uint32_t dict_size(const DictionaryIterator *iter) {
+  return dict_write_end((DictionaryIterator *) iter);
+}
+
+static void phone_send(uint32_t id, char *tuples) {
+  DictionaryIterator *message = calloc(1, sizeof(DictionaryIterator));
+  message->id = id;
+  read_tuples(message, tuples);
+  host_stats.phone_sends++;
+  host_stats.phone_bytes += dict_size(message);
+
+  if (!host_link.connected) {
+    queue_event(s_now, EVENT_PHONE_RESULT, 0, message, 0);
+  } else if (host_chance(host_link.drop_percent)) {
+    host_stats.drops++;
+    queue_event(s_now + host_link.timeout_ms, EVENT_PHONE_RESULT, 0, message, 0);
+  } else {
+    queue_event(s_now + host_link.latency_ms, EVENT_TO_WATCH, 0, dict_copy(message), 0);
+    queue_event(s_now + 2 * host_link.latency_ms, EVENT_PHONE_RESULT, 0, message, 1);
+  }
+}
+
+// Send a command to the phone, and handle its answer. Returns the answer to a query, if any.
+static char *phone_command(const char *format, ...) {
+  static char *line = NULL;
+  static size_t line_size = 0;
+  static char answer[65536];
+
+  if (!s_phone_in) {
+    return NULL;
+  }
+  va_list args;
+  va_start(args, format);
+  vfprintf(s_phone_in, format, args);
+  va_end(args);
+  fflush(s_phone_in);
+
+  answer[0] = '\0';
+  while (getline(&line, &line_size, s_phone_out) > 0) {
+    if (0 == strncmp(line, "send ", 5)) {
+      char *tuples;
+      uint32_t id = strtoul(line + 5, &tuples, 10);
+      phone_send(id, tuples);
+    } else if (0 == strncmp(line, "log ", 4)) {
+      if (s_log_level > 0) {
+        fprintf(stderr, "[%lld phone] %s", (long long) s_now, line + 4);
+      }
+    } else if (0 == strncmp(line, "next ", 5)) {
+      host_ms_t next = strtoll(line + 5, NULL, 10);
+      if (next != s_phone_timer) {
+        s_phone_timer = next;
+        s_phone_timer_generation++;
+        if (next >= 0) {
+          queue_event(next, EVENT_PHONE_TIMER, s_phone_timer_generation, NULL, 0);
+        }
+      }
+      return answer;
+    } else {
+      snprintf(answer, sizeof(answer), "%s", line);
+    }
+  }
+  fprintf(stderr, "host: lost the phone\n");
+  exit(2);
+}
+
+static void phone_start(void) {
+  int to_phone[2];
+  int from_phone[2];
+  if (pipe(to_phone) || pipe(from_phone)) {
+    perror("host: pipe");
+    exit(2);
+  }
+  s_phone_pid = fork();
+  if (0 == s_phone_pid) {
+    dup2(to_phone[0], 0);
+    dup2(from_phone[1], 1);
+    close(to_phone[1]);
+    close(from_phone[0]);
+    setenv("TZ", "UTC", 1);
+    execlp("node", "node", HOST_DIR "/phone.js", REPO_DIR, (char *) NULL);
+    perror("host: node");
+    _exit(2);
+  }
+  close(to_phone[0]);
+  close(from_phone[1]);
+  s_phone_in = fdopen(to_phone[1], "w");
+  s_phone_out = fdopen(from_phone[0], "r");
+  phone_command("start %lld %s\n", (long long) s_now, s_local_zone);
+}
+
+void host_stop(void) {
+  if (s_phone_in) {
+    fprintf(s_phone_in, "quit\n");
+    fclose(s_phone_in);
+    fclose(s_phone_out);
+    waitpid(s_phone_pid, NULL, 0);
+    s_phone_in = NULL;
+    s_phone_out = NULL;
+  }
+}
+
+/*
+ * Zone reference, from moment-timezone in the phone JS.
+ */
+
+typedef struct {
+  char name[64];
+  int count;
+  host_ms_t *untils;
+  int32_t *offsets;
+} ZoneTable;
+
+static ZoneTable s_zone_tables[64];
+static int s_zone_table_count = 0;
+
+static ZoneTable *zone_table(const char *zone) {
+  for (int i = 0; i < s_zone_table_count; i++) {
+    if (0 == strcmp(s_zone_tables[i].name, zone)) {
+      return &s_zone_tables[i];
+    }
+  }
+
+  char *answer = phone_command("table %s\n", zone);
+  ZoneTable *table = &s_zone_tables[s_zone_table_count++];
+  snprintf(table->name, sizeof(table->name), "%s", zone);
+  char *p = answer + strlen("table ");
+  table->count = strtol(p, &p, 10);
+  if (table->count <= 0) {
+    fprintf(stderr, "host: no zone %s\n", zone);
+    exit(2);
+  }
+  table->untils = calloc(table->count, sizeof(host_ms_t));
+  table->offsets = calloc(table->count, sizeof(int32_t));
+  for (int i = 0; i < table->count; i++) {
+    table->untils[i] = strtoll(p, &p, 10);
+    table->offsets[i] = strtol(p, &p, 10);
+  }
+  return table;
+}
+
+int32_t host_zone_offset(const char *zone, host_ms_t utc_ms) {
+  ZoneTable *table = zone_table(zone);
+  int i = 0;
+  while (i < table->count - 1 && utc_ms >= table->untils[i]) {
+    i++;
+  }
+  // moment offsets are minutes west of UTC
+  return -table->offsets[i];
+}
+
+uint16_t host_zone_id(const char *zone) {
+  char *answer = phone_command("id %s\n", zone);
+  return strtoul(answer + strlen("id "), NULL, 10);
+}
+
+int host_zone_names(char ***names) {
+  char *p = phone_command("names\n") + strlen("names ");
+  int count = strtol(p, &p, 10);
+  *names = calloc(count + 1, sizeof(char *));
+  (*names)[0] = strdup("");
+  for (int i = 1; i <= count; i++) {
+    p += strspn(p, " ");
+    size_t length = strcspn(p, " \n");
+    (*names)[i] = strndup(p, length);
+    p += length;
+  }
+  return count + 1;
+}
+
+int host_moment_offsets(const char *zone, host_ms_t from_ms, host_ms_t to_ms, host_ms_t step_ms, HostOffset **offsets) {
+  char *p = phone_command("offsets %s %lld %lld %lld\n", zone, (long long) from_ms, (long long) to_ms, (long long) step_ms)
+            + strlen("offsets ");
+  int count = strtol(p, &p, 10);
+  *offsets = calloc(count, sizeof(HostOffset));
+  for (int i = 0; i < count; i++) {
+    (*offsets)[i].utc_ms = strtoll(p, &p, 10);
+    (*offsets)[i].offset = strtol(p, &p, 10);
+    (*offsets)[i].next_ms = strtoll(p, &p, 10);
+  }
+  return count;
+}
+
+/*
+ * Clock
+ */
+
+static int32_t local_offset_s(void) {
+  return host_zone_offset(s_local_zone, s_now) * 60;
+}
+
+time_t host_time(time_t *t) {
+  time_t now = s_now / 1000 + local_offset_s();
+  if (t) {
+    *t = now;
+  }
+  return now;
+}
+
+uint16_t time_ms(time_t *t_utc, uint16_t *out_ms) {
+  uint16_t ms = s_now % 1000;
+  host_time(t_utc);
+  if (out_ms) {
+    *out_ms = ms;
+  }
+  return ms;
+}
+
+bool clock_is_24h_style(void) {
+  return true;
+}
+
+/*
+ * Layers and windows. Every kind of layer is a Layer, so that the watch code can
+ * destroy any of them with layer_destroy().
+ */
+
+struct Layer {
+  GRect frame;
+  bool hidden;
+  bool dirty;
+  LayerUpdateProc update_proc;
+  const char *text;
+  Layer *next;
+};
+
+struct TextLayer {
+  Layer layer;
+};
+
+struct BitmapLayer {
+  Layer layer;
+};
+
+struct Window {
+  Layer root;
+  WindowHandlers handlers;
+  bool loaded;
+};
+
+struct GContext {
+  GColor text_color;
+};
+
+static Layer *s_layers = NULL;
+static GContext s_context;
+
+static Window *s_window_stack[8];
+static int s_window_depth = 0;
+
+static Layer *new_layer(size_t size, GRect frame) {
+  Layer *layer = calloc(1, size);
+  layer->frame = frame;
+  layer->next = s_layers;
+  s_layers = layer;
+  return layer;
+}
+
+Layer *layer_create(GRect frame) {
+  return new_layer(sizeof(Layer), frame);
+}
+
+void layer_destroy(Layer *layer) {
+  for (Layer **p = &s_layers; *p; p = &(*p)->next) {
+    if (*p == layer) {
+      *p = layer->next;
+      break;
+    }
+  }
+  free(layer);
+}
+
+void layer_add_child(Layer *parent, Layer *child) {
+}
+
+void layer_remove_from_parent(Layer *child) {
+}
+
+void layer_mark_dirty(Layer *layer) {
+  layer->dirty = true;
+}
+
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc) {
+  layer->update_proc = update_proc;
+}
+
+void layer_set_hidden(Layer *layer, bool hidden) {
+  if (layer->hidden != hidden) {
+    layer->hidden = hidden;
+    layer_mark_dirty(layer);
+  }
+}
+
+GRect layer_get_frame(const Layer *layer) {
+  return layer->frame;
+}
+
+GRect layer_get_bounds(const Layer *layer) {
+  return GRect(0, 0, layer->frame.size.w, layer->frame.size.h);
+}
+
+// Redraw the dirty layers, as the system does after each event.
+static void render(void) {
+  for (Layer *layer = s_layers; layer; layer = layer->next) {
+    if (layer->dirty) {
+      layer->dirty = false;
+      if (!layer->hidden) {
+        host_stats.redraws++;
+        host_stats.redraw_area += layer->frame.size.w * layer->frame.size.h;
+      }
+      if (layer->update_proc && !layer->hidden) {
+        layer->update_proc(layer, &s_context);
+      }
+    }
+  }
+}
+
+TextLayer *text_layer_create(GRect frame) {
+  return (TextLayer *) new_layer(sizeof(TextLayer), frame);
+}
+
+void text_layer_destroy(TextLayer *text_layer) {
+  layer_destroy(&text_layer->layer);
+}
+
+Layer *text_layer_get_layer(TextLayer *text_layer) {
+  return &text_layer->layer;
+}
+
+void text_layer_set_text(TextLayer *text_layer, const char *text) {
+  text_layer->layer.text = text;
+  layer_mark_dirty(&text_layer->layer);
+}
+
+const char *text_layer_get_text(TextLayer *text_layer) {
+  return text_layer->layer.text;
+}
+
+const char *host_layer_text(TextLayer *layer) {
+  return layer ? layer->layer.text : NULL;
+}
+
+void text_layer_set_background_color(TextLayer *text_layer, GColor color) {
+}
+
+void text_layer_set_text_color(TextLayer *text_layer, GColor color) {
+}
+
+void text_layer_set_font(TextLayer *text_layer, GFont font) {
+}
+
+void text_layer_set_text_alignment(TextLayer *text_layer, GTextAlignment text_alignment) {
+}
+
+void text_layer_set_overflow_mode(TextLayer *text_layer, GTextOverflowMode line_mode) {
+}
+
+BitmapLayer *bitmap_layer_create(GRect frame) {
+  return (BitmapLayer *) new_layer(sizeof(BitmapLayer), frame);
+}
+
+void bitmap_layer_destroy(BitmapLayer *bitmap_layer) {
+  layer_destroy(&bitmap_layer->layer);
+}
+
+Layer *bitmap_layer_get_layer(const BitmapLayer *bitmap_layer) {
+  return (Layer *) &bitmap_layer->layer;
+}
+
+void bitmap_layer_set_bitmap(BitmapLayer *bitmap_layer, const GBitmap *bitmap) {
+  layer_mark_dirty(&bitmap_layer->layer);
+}
+
+void bitmap_layer_set_alignment(BitmapLayer *bitmap_layer, GAlign alignment) {
+}
+
+void bitmap_layer_set_compositing_mode(BitmapLayer *bitmap_layer, GCompOp mode) {
+}
+
+Window *window_create(void) {
+  Window *window = calloc(1, sizeof(Window));
+  window->root.frame = GRect(0, 0, 144, 168);
+  return window;
+}
+
+static void window_unload(Window *window) {
+  if (window->loaded) {
+    window->loaded = false;
+    if (window->handlers.unload) {
+      window->handlers.unload(window);
+    }
+  }
+}
+
+void window_destroy(Window *window) {
+  for (int i = 0; i < s_window_depth; i++) {
+    if (s_window_stack[i] == window) {
+      memmove(&s_window_stack[i], &s_window_stack[i + 1], (s_window_depth - i - 1) * sizeof(Window *));
+      s_window_depth--;
+      break;
+    }
+  }
+  window_unload(window);
+  free(window);
+}
+
+void window_set_background_color(Window *window, GColor color) {
+}
+
+void window_set_window_handlers(Window *window, WindowHandlers handlers) {
+  window->handlers = handlers;
+}
+
+Layer *window_get_root_layer(const Window *window) {
+  return (Layer *) &window->root;
+}
+
+void window_stack_push(Window *window, bool animated) {
+  s_window_stack[s_window_depth++] = window;
+  if (!window->loaded) {
+    window->loaded = true;
+    if (window->handlers.load) {
+      window->handlers.load(window);
+    }
+  }
+}
+
+Window *window_stack_pop(bool animated) {
+  if (0 == s_window_depth) {
+    return NULL;
+  }
+  Window *window = s_window_stack[--s_window_depth];
+  window_unload(window);
+  return window;
+}
+
+Window *window_stack_get_top_window(void) {
+  return s_window_depth ? s_window_stack[s_window_depth - 1] : NULL;
+}
+
+/*
+ * Graphics, fonts and resources
+ */
+
+static int s_dummy_font;
+static GBitmap *s_dummy_bitmap = (GBitmap *) &s_dummy_font;
+static FILE *s_rules = NULL;
+
+// Text is laid out at about 8 pixels a character, whatever the font.
+GSize text_layer_get_content_size(TextLayer *text_layer) {
+  int16_t characters = 0;
+  for (const char *text = text_layer->layer.text ? text_layer->layer.text : ""; *text; text++) {
+    if ((*text & 0xc0) != 0x80) {
+      characters++;
+    }
+  }
+  return GSize(characters * 8, 18);
+}
+
+void graphics_draw_text(GContext *ctx, const char *text, GFont const font, const GRect box,
+                        const GTextOverflowMode overflow_mode, const GTextAlignment alignment, void *text_attributes) {
+}
+
+void graphics_context_set_text_color(GContext *ctx, GColor color) {
+  ctx->text_color = color;
+}
+
+GFont fonts_get_system_font(const char *font_key) {
+  return &s_dummy_font;
+}
+
+GFont fonts_load_custom_font(ResHandle handle) {
+  return &s_dummy_font;
+}
+
+void fonts_unload_custom_font(GFont font) {
+}
+
+GBitmap *gbitmap_create_with_resource(uint32_t resource_id) {
+  return s_dummy_bitmap;
+}
+
+void gbitmap_destroy(GBitmap *bitmap) {
+}
+
+ResHandle resource_get_handle(uint32_t resource_id) {
+  if (RESOURCE_ID_TZ_RULES != resource_id) {
+    return &s_dummy_font;
+  }
+  if (!s_rules) {
+    s_rules = fopen(TZRULES_BIN, "rb");
+    if (!s_rules) {
+      perror("host: " TZRULES_BIN);
+      exit(2);
+    }
+  }
+  return s_rules;
+}
+
+size_t resource_size(ResHandle h) {
+  if (h != s_rules) {
+    return 0;
+  }
+  fseek(s_rules, 0, SEEK_END);
+  return ftell(s_rules);
+}
+
+size_t resource_load_byte_range(ResHandle h, uint32_t start_offset, uint8_t *buffer, size_t num_bytes) {
+  if (h != s_rules || fseek(s_rules, start_offset, SEEK_SET)) {
+    return 0;
+  }
+  host_stats.resource_reads++;
+  host_stats.resource_bytes += num_bytes;
+  return fread(buffer, 1, num_bytes, s_rules);
+}
+
+size_t resource_load(ResHandle h, uint8_t *buffer, size_t max_length) {
+  return resource_load_byte_range(h, 0, buffer, max_length);
+}
+
+/*
+ * Event services
+ */
+
+static TickHandler s_tick_handler = NULL;
+static TimeUnits s_tick_units = 0;
+static uint32_t s_tick_generation = 0;
+static struct tm s_last_tick;
+
+static void (*s_bluetooth_handler)(bool connected) = NULL;
+static void (*s_battery_handler)(BatteryChargeState charge) = NULL;
+static void (*s_tap_handler)(AccelAxisType axis, int32_t direction) = NULL;
+static BatteryChargeState s_battery = { 80, false, false };
+
+static void schedule_tick(void) {
+  host_ms_t unit_ms = (s_tick_units & SECOND_UNIT) ? 1000 : 60000;
+  queue_event((s_now / unit_ms + 1) * unit_ms, EVENT_TICK, s_tick_generation, NULL, 0);
+}
+
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler) {
+  host_stats.subscriptions++;
+  s_tick_handler = handler;
+  s_tick_units = tick_units;
+  s_tick_generation++;
+  time_t now = host_time(NULL);
+  gmtime_r(&now, &s_last_tick);
+  schedule_tick();
+}
+
+void tick_timer_service_unsubscribe(void) {
+  s_tick_handler = NULL;
+  s_tick_generation++;
+}
+
+static void tick(void) {
+  struct tm tick_time;
+  time_t now = host_time(NULL);
+  gmtime_r(&now, &tick_time);
+
+  TimeUnits changed = 0;
+  changed |= (tick_time.tm_sec != s_last_tick.tm_sec) ? SECOND_UNIT : 0;
+  changed |= (tick_time.tm_min != s_last_tick.tm_min) ? MINUTE_UNIT : 0;
+  changed |= (tick_time.tm_hour != s_last_tick.tm_hour) ? HOUR_UNIT : 0;
+  changed |= (tick_time.tm_mday != s_last_tick.tm_mday) ? DAY_UNIT : 0;
+  changed |= (tick_time.tm_mon != s_last_tick.tm_mon) ? MONTH_UNIT : 0;
+  changed |= (tick_time.tm_year != s_last_tick.tm_year) ? YEAR_UNIT : 0;
+  s_last_tick = tick_time;
+
+  schedule_tick();
+  if (changed & s_tick_units) {
+    s_tick_handler(&tick_time, changed);
+  }
+}
+
+void bluetooth_connection_service_subscribe(void (*handler)(bool connected)) {
+  host_stats.subscriptions++;
+  s_bluetooth_handler = handler;
+}
+
+void bluetooth_connection_service_unsubscribe(void) {
+  s_bluetooth_handler = NULL;
+}
+
+bool bluetooth_connection_service_peek(void) {
+  return host_link.connected;
+}
+
+void battery_state_service_subscribe(void (*handler)(BatteryChargeState charge)) {
+  host_stats.subscriptions++;
+  s_battery_handler = handler;
+}
+
+void battery_state_service_unsubscribe(void) {
+  s_battery_handler = NULL;
+}
+
+BatteryChargeState battery_state_service_peek(void) {
+  return s_battery;
+}
+
+void accel_tap_service_subscribe(void (*handler)(AccelAxisType axis, int32_t direction)) {
+  host_stats.subscriptions++;
+  s_tap_handler = handler;
+}
+
+void accel_tap_service_unsubscribe(void) {
+  s_tap_handler = NULL;
+}
+
+void vibes_double_pulse(void) {
+  host_stats.vibes++;
+}
+
+/*
+ * Timers. Handles are reused round robin, so that cancelling a stale handle,
+ * which the SDK tolerates, does not touch freed memory.
+ */
+
+struct AppTimer {
+  AppTimerCallback callback;
+  void *data;
+  uint32_t generation;
+  bool live;
+};
+
+#define HOST_TIMERS (256)
+static AppTimer s_timers[HOST_TIMERS];
+static int s_next_timer = 0;
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data) {
+  for (int i = 0; i < HOST_TIMERS; i++) {
+    AppTimer *timer = &s_timers[(s_next_timer + i) % HOST_TIMERS];
+    if (!timer->live) {
+      s_next_timer = (s_next_timer + i + 1) % HOST_TIMERS;
+      timer->callback = callback;
+      timer->data = callback_data;
+      timer->generation++;
+      timer->live = true;
+      queue_event(s_now + timeout_ms, EVENT_TIMER, timer->generation, timer, 0);
+      return timer;
+    }
+  }
+  fprintf(stderr, "host: out of timers\n");
+  exit(2);
+}
+
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms) {
+  if (!timer_handle || !timer_handle->live) {
+    return false;
+  }
+  timer_handle->generation++;
+  queue_event(s_now + new_timeout_ms, EVENT_TIMER, timer_handle->generation, timer_handle, 0);
+  return true;
+}
+
+void app_timer_cancel(AppTimer *timer_handle) {
+  if (timer_handle) {
+    timer_handle->live = false;
+  }
+}
+
+/*
+ * AppMessage. One message in flight from the watch at a time: the outbox is busy
+ * until the phone acks it, or the send times out.
+ */
+
+static AppMessageInboxReceived s_inbox_received = NULL;
+static AppMessageOutboxSent s_outbox_sent = NULL;
+static AppMessageOutboxFailed s_outbox_failed = NULL;
+static uint32_t s_inbox_size = 0;
+static uint32_t s_outbox_size = 0;
+static DictionaryIterator s_outbox;
+static bool s_outbox_open = false;
+static bool s_outbox_in_flight = false;
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound) {
+  s_inbox_size = size_inbound;
+  s_outbox_size = size_outbound;
+  return APP_MSG_OK;
+}
+
+uint32_t app_message_inbox_size_maximum(void) {
+  return 2026;
+}
+
+uint32_t app_message_outbox_size_maximum(void) {
+  return 656;
+}
+
+void app_message_register_inbox_received(AppMessageInboxReceived received_callback) {
+  s_inbox_received = received_callback;
+}
+
+void app_message_register_outbox_sent(AppMessageOutboxSent sent_callback) {
+  s_outbox_sent = sent_callback;
+}
+
+void app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback) {
+  s_outbox_failed = failed_callback;
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator) {
+  if (s_outbox_open || s_outbox_in_flight || host_chance(host_link.busy_percent)) {
+    host_stats.watch_busy++;
+    return APP_MSG_BUSY;
+  }
+  dict_clear(&s_outbox);
+  s_outbox.capacity = s_outbox_size;
+  s_outbox_open = true;
+  *iterator = &s_outbox;
+  return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_send(void) {
+  if (!s_outbox_open) {
+    return APP_MSG_INVALID_ARGS;
+  }
+  s_outbox_open = false;
+  s_outbox_in_flight = true;
+  host_stats.watch_sends++;
+  host_stats.watch_bytes += dict_size(&s_outbox);
+
+  DictionaryIterator *message = dict_copy(&s_outbox);
+  if (!host_link.connected) {
+    queue_event(s_now, EVENT_WATCH_RESULT, 0, message, APP_MSG_NOT_CONNECTED);
+  } else if (host_chance(host_link.drop_percent)) {
+    host_stats.drops++;
+    queue_event(s_now + host_link.timeout_ms, EVENT_WATCH_RESULT, 0, message, APP_MSG_SEND_TIMEOUT);
+  } else {
+    queue_event(s_now + host_link.latency_ms, EVENT_TO_PHONE, 0, dict_copy(message), 0);
+    queue_event(s_now + 2 * host_link.latency_ms, EVENT_WATCH_RESULT, 0, message, APP_MSG_OK);
+  }
+  return APP_MSG_OK;
+}
+
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key) {
+  for (int i = 0; i < iter->count; i++) {
+    if (iter->tuples[i]->key == key) {
+      return iter->tuples[i];
+    }
+  }
+  return NULL;
+}
+
+int dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t *data, const uint16_t size) {
+  return dict_add(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+int dict_write_cstring(DictionaryIterator *iter, const uint32_t key, const char *cstring) {
+  return dict_add(iter, key, TUPLE_CSTRING, cstring, strlen(cstring) + 1);
+}
+
+int dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value) {
+  return dict_add(iter, key, TUPLE_UINT, &value, sizeof(value));
+}
+
+int dict_write_int32(DictionaryIterator *iter, const uint32_t key, const int32_t value) {
+  return dict_add(iter, key, TUPLE_INT, &value, sizeof(value));
+}
+
+// As the SDK's serialised size: a count byte, and a 7 byte header per tuple.
+uint32_t dict_write_end(DictionaryIterator *iter) {
+  uint32_t size = 1;
+  for (int i = 0; i < iter->count; i++) {
+    size += 7 + iter->tuples[i]->length;
+  }
+  return size;
+}
+
+/*
+ * Persistent storage, limited to PERSIST_DATA_MAX_LENGTH bytes a key as on the watch.
+ */
+
+typedef struct {
+  uint32_t key;
+  int size;
+  uint8_t data[PERSIST_DATA_MAX_LENGTH];
+} PersistEntry;
+
+static PersistEntry s_persist[64];
+static int s_persist_count = 0;
+
+static PersistEntry *persist_find(uint32_t key) {
+  for (int i = 0; i < s_persist_count; i++) {
+    if (s_persist[i].key == key) {
+      return &s_persist[i];
+    }
+  }
+  return NULL;
+}
+
+static int persist_store(uint32_t key, const void *data, size_t size) {
+  if (size > PERSIST_DATA_MAX_LENGTH) {
+    fprintf(stderr, "host: persistent write of %zu bytes to key %u is over the limit\n", size, key);
+    return E_RANGE;
+  }
+  PersistEntry *entry = persist_find(key);
+  if (!entry) {
+    entry = &s_persist[s_persist_count++];
+    entry->key = key;
+  }
+  memcpy(entry->data, data, size);
+  entry->size = size;
+  host_stats.persist_writes++;
+  host_stats.persist_bytes += size;
+  return size;
+}
+
+int host_persist_size(uint32_t key) {
+  PersistEntry *entry = persist_find(key);
+  return entry ? entry->size : -1;
+}
+
+bool persist_exists(const uint32_t key) {
+  return NULL != persist_find(key);
+}
+
+status_t persist_delete(const uint32_t key) {
+  PersistEntry *entry = persist_find(key);
+  if (!entry) {
+    return E_DOES_NOT_EXIST;
+  }
+  *entry = s_persist[--s_persist_count];
+  host_stats.persist_writes++;
+  return S_SUCCESS;
+}
+
+int32_t persist_read_int(const uint32_t key) {
+  int32_t value = 0;
+  persist_read_data(key, &value, sizeof(value));
+  return value;
+}
+
+bool persist_read_bool(const uint32_t key) {
+  return persist_read_int(key) != 0;
+}
+
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size) {
+  PersistEntry *entry = persist_find(key);
+  if (!entry) {
+    return E_DOES_NOT_EXIST;
+  }
+  size_t size = (size_t) entry->size < buffer_size ? (size_t) entry->size : buffer_size;
+  memcpy(buffer, entry->data, size);
+  return size;
+}
+
+int persist_read_string(const uint32_t key, char *buffer, const size_t buffer_size) {
+  int size = persist_read_data(key, buffer, buffer_size);
+  if (size > 0) {
+    buffer[buffer_size - 1] = '\0';
+  }
+  return size;
+}
+
+status_t persist_write_int(const uint32_t key, const int32_t value) {
+  return persist_store(key, &value, sizeof(value)) < 0 ? E_RANGE : S_SUCCESS;
+}
+
+status_t persist_write_bool(const uint32_t key, const bool value) {
+  return persist_write_int(key, value);
+}
+
+int persist_write_data(const uint32_t key, const void *data, const size_t size) {
+  return persist_store(key, data, size);
+}
+
+int persist_write_string(const uint32_t key, const char *cstring) {
+  return persist_store(key, cstring, strlen(cstring) + 1);
+}
+
+void app_event_loop(void) {
+}
+
+/*
+ * Simulation
+ */
+
+// The system redraws the dirty layers after each event the watch handles.
+static void watch_event_done(void) {
+  host_stats.wakeups++;
+  render();
+}
+
+static void handle_event(Event *e) {
+  switch (e->type) {
+    case EVENT_TICK:
+      if (e->generation == s_tick_generation && s_tick_handler) {
+        tick();
+        watch_event_done();
+      }
+      break;
+
+    case EVENT_TIMER: {
+      AppTimer *timer = e->data;
+      if (timer->live && timer->generation == e->generation) {
+        timer->live = false;
+        timer->callback(timer->data);
+        watch_event_done();
+      }
+      break;
+    }
+
+    case EVENT_TO_PHONE: {
+      DictionaryIterator *message = e->data;
+      // Messages reach the phone app, but are lost until the JS is ready.
+      if (s_phone_ready) {
+        fprintf(s_phone_in, "msg %lld", (long long) s_now);
+        write_tuples(s_phone_in, message);
+        phone_command("\n");
+      }
+      dict_free(message);
+      break;
+    }
+
+    case EVENT_TO_WATCH: {
+      DictionaryIterator *message = e->data;
+      if (s_inbox_received && dict_size(message) <= s_inbox_size) {
+        s_inbox_received(message, NULL);
+        watch_event_done();
+      }
+      dict_free(message);
+      break;
+    }
+
+    case EVENT_WATCH_RESULT: {
+      DictionaryIterator *message = e->data;
+      s_outbox_in_flight = false;
+      if (APP_MSG_OK == e->value) {
+        if (s_outbox_sent) {
+          s_outbox_sent(message, NULL);
+        }
+      } else {
+        host_stats.watch_failed++;
+        if (s_outbox_failed) {
+          s_outbox_failed(message, e->value, NULL);
+        }
+      }
+      dict_free(message);
+      watch_event_done();
+      break;
+    }
+
+    case EVENT_PHONE_RESULT: {
+      DictionaryIterator *message = e->data;
+      if (!e->value) {
+        host_stats.phone_failed++;
+      }
+      phone_command("%s %lld %u\n", e->value ? "ack" : "nack", (long long) s_now, message->id);
+      dict_free(message);
+      break;
+    }
+
+    case EVENT_PHONE_TIMER:
+      if (e->generation == s_phone_timer_generation) {
+        s_phone_timer = -1;
+        phone_command("run %lld\n", (long long) s_now);
+      }
+      break;
+  }
+}
+
+void host_run_until(host_ms_t utc_ms) {
+  while (s_event_count > 0 && s_events[0].when <= utc_ms) {
+    Event e = pop_event();
+    if (e.when > s_now) {
+      s_now = e.when;
+    }
+    handle_event(&e);
+
+    // Check once all that happens at this instant has, e.g. a tick and the redraw it schedules.
+    if (host_after_event && (0 == s_event_count || s_events[0].when > s_now)) {
+      host_after_event();
+    }
+  }
+  if (utc_ms > s_now) {
+    s_now = utc_ms;
+  }
+}
+
+void host_run_for(host_ms_t ms) {
+  host_run_until(s_now + ms);
+}
+
+void host_start(host_ms_t utc_ms, const char *local_zone) {
+  const char *log = getenv("HOST_LOG");
+  const char *seed = getenv("HOST_SEED");
+  s_log_level = log ? atoi(log) : 0;
+  if (seed) {
+    s_random = strtoul(seed, NULL, 10) | 1;
+  }
+  setenv("TZ", "UTC", 1);
+  tzset();
+
+  s_now = utc_ms;
+  s_local_zone = local_zone;
+  phone_start();
+}
+
+void host_set_local_zone(const char *zone) {
+  s_local_zone = zone;
+  phone_command("zone %lld %s\n", (long long) s_now, zone);
+
+  // The local time has changed under the watch
+  if (host_after_event) {
+    host_after_event();
+  }
+}
+
+const char *host_local_zone(void) {
+  return s_local_zone;
+}
+
+void host_set_connected(bool connected) {
+  host_link.connected = connected;
+  if (s_bluetooth_handler) {
+    s_bluetooth_handler(connected);
+    watch_event_done();
+  }
+}
+
+void host_set_battery(uint8_t percent, bool plugged) {
+  s_battery.charge_percent = percent;
+  s_battery.is_plugged = plugged;
+  s_battery.is_charging = plugged && percent < 100;
+  if (s_battery_handler) {
+    s_battery_handler(s_battery);
+    watch_event_done();
+  }
+}
+
+void host_phone_ready(void) {
+  s_phone_ready = true;
+  phone_command("ready %lld\n", (long long) s_now);
+}
+
+void host_phone_restart(void) {
+  s_phone_ready = false;
+  phone_command("start %lld %s\n", (long long) s_now, s_local_zone);
+}
+
+void host_phone_configure(const char *json) {
+  fprintf(s_phone_in, "config %lld ", (long long) s_now);
+  for (const char *p = json; *p; p++) {
+    fprintf(s_phone_in, "%02x", (uint8_t) *p);
+  }
+  phone_command("\n");
+}
+
+void host_phone_store(const char *json) {
+  fprintf(s_phone_in, "store ");
+  for (const char *p = json; *p; p++) {
+    fprintf(s_phone_in, "%02x", (uint8_t) *p);
+  }
+  phone_command("\n");
+}
+
+void host_tap(AccelAxisType axis, int32_t direction) {
+  if (s_tap_handler) {
+    s_tap_handler(axis, direction);
+    watch_event_done();
+  }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * Host harness for the watch code: a simulated watch (clock, display, storage,
+ * event services) driven by an event queue in simulated time, linked to the
+ * phone JS (src/utc.js and zoneids.js) running under Node in phone.js, through a fake AppMessage
+ * transport with configurable latency, drops and APP_MSG_BUSY.
+ *
+ * The scenario programs include src/main.c directly, with its main() renamed,
+ * so that they can call its init() and check its state.
+ */
+
+// Simulated time, in milliseconds since the epoch (UTC).
+typedef int64_t host_ms_t;
+
+// AppMessage link between the watch and the phone.
+typedef struct {
+  uint32_t latency_ms;       // One way; acks take a round trip
+  uint32_t timeout_ms;       // Before a dropped message is reported failed
+  uint8_t drop_percent;      // Messages lost, either way
+  uint8_t busy_percent;      // Watch outbox opens refused with APP_MSG_BUSY, beyond a message in flight
+  bool connected;            // Bluetooth
+} HostLink;
+
+extern HostLink host_link;
+
+// Traffic and activity counters, reset by host_reset_stats().
+typedef struct {
+  uint32_t watch_sends;      // Messages sent by the watch
+  uint32_t watch_bytes;
+  uint32_t watch_busy;       // Outbox opens refused
+  uint32_t watch_failed;     // Outbox failed callbacks
+  uint32_t phone_sends;      // Messages sent by the phone
+  uint32_t phone_bytes;
+  uint32_t phone_failed;     // Nacks to the phone
+  uint32_t drops;            // Messages lost on the link, either way
+  uint32_t persist_writes;   // Writes and deletes
+  uint32_t persist_bytes;
+  uint32_t resource_reads;
+  uint32_t resource_bytes;
+  uint32_t wakeups;          // Watch handlers run: ticks, timers, messages, taps...
+  uint32_t redraws;          // Layers redrawn
+  uint32_t redraw_area;      // Pixels of the layers redrawn
+  uint32_t vibes;
+  uint32_t subscriptions;    // Event service subscriptions, including changes of tick unit
+} HostStats;
+
+extern HostStats host_stats;
+
+void host_reset_stats(void);
+
+// Start the simulation at the given UTC time with the phone in the given zone, and
+// launch the phone JS. The watch itself is started by calling main.c's init().
+void host_start(host_ms_t utc_ms, const char *local_zone);
+
+// Stop the phone JS.
+void host_stop(void);
+
+// Run the simulation until the given time, or for a while.
+void host_run_until(host_ms_t utc_ms);
+void host_run_for(host_ms_t ms);
+
+// Called once the events at each instant have been handled, e.g. to check the display.
+extern void (*host_after_event)(void);
+
+// Current simulated time.
+host_ms_t host_now(void);
+
+// Move the phone, and so the watch's clock, to another timezone.
+void host_set_local_zone(const char *zone);
+const char *host_local_zone(void);
+
+// Bluetooth connection changes, as seen by both sides.
+void host_set_connected(bool connected);
+
+// Battery state changes.
+void host_set_battery(uint8_t percent, bool plugged);
+
+// The phone JS becomes ready (Pebble "ready" event).
+void host_phone_ready(void);
+
+// The phone JS is restarted, keeping its localStorage, and is not ready until host_phone_ready().
+void host_phone_restart(void);
+
+// Configuration returned by the configuration page (Pebble "webviewclosed" event), as JSON.
+void host_phone_configure(const char *json);
+
+// Items set in the phone JS's localStorage, as a JSON object, without any event.
+void host_phone_store(const char *json);
+
+// Shake the watch.
+void host_tap(AccelAxisType axis, int32_t direction);
+
+// Zone reference from moment-timezone in the phone JS: the zone ID, and its offset
+// (minutes east of UTC) at a UTC time.
+uint16_t host_zone_id(const char *zone);
+int32_t host_zone_offset(const char *zone, host_ms_t utc_ms);
+
+// All zone names, indexed by ID (names[0] is "" for no zone). Returns the number of IDs.
+int host_zone_names(char ***names);
+
+// Offsets of a zone computed by moment-timezone, at each step from from_ms to to_ms and
+// either side of each transition, with the next transition (-1 if none) after each.
+// Returns the number of offsets, 0 if moment-timezone does not know the zone.
+typedef struct {
+  host_ms_t utc_ms;
+  int32_t offset;
+  host_ms_t next_ms;
+} HostOffset;
+
+int host_moment_offsets(const char *zone, host_ms_t from_ms, host_ms_t to_ms, host_ms_t step_ms, HostOffset **offsets);
+
+// Text shown by a text layer, NULL if none.
+const char *host_layer_text(TextLayer *layer);
+
+// Persisted value size for a key, -1 if none.
+int host_persist_size(uint32_t key);
@@ -0,0 +1,241 @@
+#pragma once
+
+/*
+ * Host build of the subset of the Pebble SDK 2 API used by the watch code, implemented
+ * by host.c against a simulated clock, display, storage and AppMessage link.
+ * Only what a watchface can use is declared: watchfaces get no button presses.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// The watch's clock is simulated, and like the SDK's time() it counts local time.
+time_t host_time(time_t *t);
+#define time(t) host_time(t)
+
+typedef struct Window Window;
+typedef struct Layer Layer;
+typedef struct TextLayer TextLayer;
+typedef struct BitmapLayer BitmapLayer;
+typedef struct GBitmap GBitmap;
+typedef struct GContext GContext;
+typedef struct AppTimer AppTimer;
+typedef struct DictionaryIterator DictionaryIterator;
+typedef void *GFont;
+typedef void *ResHandle;
+typedef int32_t status_t;
+
+typedef struct { int16_t x, y; } GPoint;
+typedef struct { int16_t w, h; } GSize;
+typedef struct { GPoint origin; GSize size; } GRect;
+#define GRect(x, y, w, h) ((GRect) { { (x), (y) }, { (w), (h) } })
+#define GSize(w, h) ((GSize) { (w), (h) })
+#define GPoint(x, y) ((GPoint) { (x), (y) })
+
+typedef enum { GColorClear = ~0, GColorBlack = 0, GColorWhite = 1 } GColor;
+typedef enum { GTextAlignmentLeft, GTextAlignmentCenter, GTextAlignmentRight } GTextAlignment;
+typedef enum { GAlignCenter, GAlignTopLeft, GAlignTopRight, GAlignTop, GAlignLeft, GAlignBottom, GAlignRight, GAlignBottomRight, GAlignBottomLeft } GAlign;
+typedef enum { GCompOpAssign, GCompOpAssignInverted, GCompOpOr, GCompOpAnd, GCompOpClear, GCompOpSet } GCompOp;
+typedef enum { GTextOverflowModeWordWrap, GTextOverflowModeTrailingEllipsis, GTextOverflowModeFill } GTextOverflowMode;
+typedef enum { SECOND_UNIT = 1 << 0, MINUTE_UNIT = 1 << 1, HOUR_UNIT = 1 << 2, DAY_UNIT = 1 << 3, MONTH_UNIT = 1 << 4, YEAR_UNIT = 1 << 5 } TimeUnits;
+typedef enum { ACCEL_AXIS_X, ACCEL_AXIS_Y, ACCEL_AXIS_Z } AccelAxisType;
+
+typedef enum {
+  APP_MSG_OK = 0,
+  APP_MSG_SEND_TIMEOUT = 1 << 1,
+  APP_MSG_SEND_REJECTED = 1 << 2,
+  APP_MSG_NOT_CONNECTED = 1 << 3,
+  APP_MSG_APP_NOT_RUNNING = 1 << 4,
+  APP_MSG_INVALID_ARGS = 1 << 5,
+  APP_MSG_BUSY = 1 << 6,
+  APP_MSG_BUFFER_OVERFLOW = 1 << 7
+} AppMessageResult;
+
+enum { S_SUCCESS = 0, E_ERROR = -1, E_INVALID_ARGUMENT = -2, E_RANGE = -8, E_DOES_NOT_EXIST = -9 };
+
+typedef struct {
+  uint8_t charge_percent;
+  bool is_charging;
+  bool is_plugged;
+} BatteryChargeState;
+
+typedef enum { TUPLE_BYTE_ARRAY = 0, TUPLE_CSTRING = 1, TUPLE_UINT = 2, TUPLE_INT = 3 } TupleType;
+
+typedef union {
+  uint8_t data[0];
+  char cstring[0];
+  uint8_t uint8;
+  uint16_t uint16;
+  uint32_t uint32;
+  int8_t int8;
+  int16_t int16;
+  int32_t int32;
+} TupleValue;
+
+typedef struct {
+  uint32_t key;
+  TupleType type;
+  uint16_t length;
+  TupleValue value[];
+} Tuple;
+
+typedef struct {
+  void (*load)(Window *window);
+  void (*appear)(Window *window);
+  void (*disappear)(Window *window);
+  void (*unload)(Window *window);
+} WindowHandlers;
+
+typedef void (*AppTimerCallback)(void *data);
+typedef void (*LayerUpdateProc)(Layer *layer, GContext *ctx);
+typedef void (*TickHandler)(struct tm *tick_time, TimeUnits units_changed);
+typedef void (*AppMessageInboxReceived)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageOutboxSent)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageOutboxFailed)(DictionaryIterator *iterator, AppMessageResult reason, void *context);
+
+// Logging
+enum { APP_LOG_LEVEL_ERROR = 1, APP_LOG_LEVEL_WARNING = 50, APP_LOG_LEVEL_INFO = 100, APP_LOG_LEVEL_DEBUG = 200, APP_LOG_LEVEL_DEBUG_VERBOSE = 255 };
+void app_log(uint8_t level, const char *filename, int line, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+#define APP_LOG(level, fmt, ...) app_log(level, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+
+// Resources, numbered as the SDK would from appinfo.json
+enum {
+  RESOURCE_ID_FONT_COMFORTAA_REGULAR_15 = 1,
+  RESOURCE_ID_FONT_COMFORTAA_BOLD_23,
+  RESOURCE_ID_FONT_COMFORTAA_BOLD_33,
+  RESOURCE_ID_BMP_BT,
+  RESOURCE_ID_BMP_NOBT,
+  RESOURCE_ID_BMP_CHARGE,
+  RESOURCE_ID_BMP_NOCHARGE,
+  RESOURCE_ID_BMP_00,
+  RESOURCE_ID_BMP_10,
+  RESOURCE_ID_BMP_20,
+  RESOURCE_ID_BMP_30,
+  RESOURCE_ID_BMP_40,
+  RESOURCE_ID_BMP_50,
+  RESOURCE_ID_BMP_60,
+  RESOURCE_ID_BMP_70,
+  RESOURCE_ID_BMP_80,
+  RESOURCE_ID_BMP_90,
+  RESOURCE_ID_TZ_RULES
+};
+
+#define FONT_KEY_GOTHIC_14 "RESOURCE_ID_GOTHIC_14"
+#define FONT_KEY_GOTHIC_18_BOLD "RESOURCE_ID_GOTHIC_18_BOLD"
+
+#define PERSIST_DATA_MAX_LENGTH 256
+#define PERSIST_STRING_MAX_LENGTH PERSIST_DATA_MAX_LENGTH
+
+// Windows
+Window *window_create(void);
+void window_destroy(Window *window);
+void window_set_background_color(Window *window, GColor color);
+void window_set_window_handlers(Window *window, WindowHandlers handlers);
+Layer *window_get_root_layer(const Window *window);
+void window_stack_push(Window *window, bool animated);
+Window *window_stack_pop(bool animated);
+Window *window_stack_get_top_window(void);
+
+// Layers
+Layer *layer_create(GRect frame);
+void layer_destroy(Layer *layer);
+void layer_add_child(Layer *parent, Layer *child);
+void layer_remove_from_parent(Layer *child);
+void layer_mark_dirty(Layer *layer);
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc);
+void layer_set_hidden(Layer *layer, bool hidden);
+GRect layer_get_frame(const Layer *layer);
+GRect layer_get_bounds(const Layer *layer);
+
+TextLayer *text_layer_create(GRect frame);
+void text_layer_destroy(TextLayer *text_layer);
+Layer *text_layer_get_layer(TextLayer *text_layer);
+void text_layer_set_text(TextLayer *text_layer, const char *text);
+const char *text_layer_get_text(TextLayer *text_layer);
+void text_layer_set_background_color(TextLayer *text_layer, GColor color);
+void text_layer_set_text_color(TextLayer *text_layer, GColor color);
+void text_layer_set_font(TextLayer *text_layer, GFont font);
+GSize text_layer_get_content_size(TextLayer *text_layer);
+void text_layer_set_text_alignment(TextLayer *text_layer, GTextAlignment text_alignment);
+void text_layer_set_overflow_mode(TextLayer *text_layer, GTextOverflowMode line_mode);
+
+BitmapLayer *bitmap_layer_create(GRect frame);
+void bitmap_layer_destroy(BitmapLayer *bitmap_layer);
+Layer *bitmap_layer_get_layer(const BitmapLayer *bitmap_layer);
+void bitmap_layer_set_bitmap(BitmapLayer *bitmap_layer, const GBitmap *bitmap);
+void bitmap_layer_set_alignment(BitmapLayer *bitmap_layer, GAlign alignment);
+void bitmap_layer_set_compositing_mode(BitmapLayer *bitmap_layer, GCompOp mode);
+
+// Graphics and fonts
+void graphics_draw_text(GContext *ctx, const char *text, GFont const font, const GRect box,
+                        const GTextOverflowMode overflow_mode, const GTextAlignment alignment, void *text_attributes);
+void graphics_context_set_text_color(GContext *ctx, GColor color);
+GFont fonts_get_system_font(const char *font_key);
+GFont fonts_load_custom_font(ResHandle handle);
+void fonts_unload_custom_font(GFont font);
+GBitmap *gbitmap_create_with_resource(uint32_t resource_id);
+void gbitmap_destroy(GBitmap *bitmap);
+
+// Resources
+ResHandle resource_get_handle(uint32_t resource_id);
+size_t resource_size(ResHandle h);
+size_t resource_load(ResHandle h, uint8_t *buffer, size_t max_length);
+size_t resource_load_byte_range(ResHandle h, uint32_t start_offset, uint8_t *buffer, size_t num_bytes);
+
+// Event services
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler);
+void tick_timer_service_unsubscribe(void);
+void bluetooth_connection_service_subscribe(void (*handler)(bool connected));
+void bluetooth_connection_service_unsubscribe(void);
+bool bluetooth_connection_service_peek(void);
+void battery_state_service_subscribe(void (*handler)(BatteryChargeState charge));
+void battery_state_service_unsubscribe(void);
+BatteryChargeState battery_state_service_peek(void);
+void accel_tap_service_subscribe(void (*handler)(AccelAxisType axis, int32_t direction));
+void accel_tap_service_unsubscribe(void);
+void vibes_double_pulse(void);
+
+// Time
+bool clock_is_24h_style(void);
+uint16_t time_ms(time_t *t_utc, uint16_t *out_ms);
+
+// Timers
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data);
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms);
+void app_timer_cancel(AppTimer *timer_handle);
+
+// AppMessage and dictionaries
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound);
+uint32_t app_message_inbox_size_maximum(void);
+uint32_t app_message_outbox_size_maximum(void);
+void app_message_register_inbox_received(AppMessageInboxReceived received_callback);
+void app_message_register_outbox_sent(AppMessageOutboxSent sent_callback);
+void app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback);
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator);
+AppMessageResult app_message_outbox_send(void);
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key);
+int dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t *data, const uint16_t size);
+int dict_write_cstring(DictionaryIterator *iter, const uint32_t key, const char *cstring);
+int dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value);
+int dict_write_int32(DictionaryIterator *iter, const uint32_t key, const int32_t value);
+uint32_t dict_write_end(DictionaryIterator *iter);
+
+// Persistent storage
+bool persist_exists(const uint32_t key);
+status_t persist_delete(const uint32_t key);
+int32_t persist_read_int(const uint32_t key);
+bool persist_read_bool(const uint32_t key);
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size);
+int persist_read_string(const uint32_t key, char *buffer, const size_t buffer_size);
+status_t persist_write_int(const uint32_t key, const int32_t value);
+status_t persist_write_bool(const uint32_t key, const bool value);
+int persist_write_data(const uint32_t key, const void *data, const size_t size);
+int persist_write_string(const uint32_t key, const char *cstring);
+
+// App
+void app_event_loop(void);
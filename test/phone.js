@@ -0,0 +1,304 @@
+// Phone side of the host harness: runs the phone JS (src/*.js, concatenated in
+// name order as wscript does) in a sandbox whose clock, timezone, timers,
+// localStorage and Pebble object are driven by host.c over stdin/stdout.
+//
+// Commands, one per line, each answered by the messages the JS sent
+// ("send <id> <tuples>") and then the time of its next timer ("next <ms>", -1
+// for none):
+//   start <ms> <zone>       (re)load the JS with the phone in the given zone, keeping localStorage
+//   ready <ms>              Pebble "ready" event
+//   msg <ms> <tuples>       message from the watch
+//   config <ms> <hex JSON>  configuration page closed
+//   store <hex JSON>        set localStorage items, e.g. a configuration saved earlier
+//   ack|nack <ms> <id>      result of a message sent by the JS
+//   run <ms>                run the timers due
+//   zone <ms> <zone>        move the phone to another zone
+//   table <zone>            reference: "table <count> (<until ms> <offset west>)*"
+//   id <zone>               the zone's ID: "id <id>"
+//   names                   all zones by ID: "names <count> <name for ID 1>..."
+//   offsets <zone> <from ms> <to ms> <step ms>
+//                           moment-timezone offsets (minutes east) at each step, and either
+//                           side of each transition, with the next transition after each:
+//                           "offsets <count> (<ms> <offset> <next ms or -1>)*"
+// Tuples are key:type:value, with type b (hex bytes), s (hex UTF-8) or i (integer).
+"use strict";
+
+var fs = require("fs");
+var path = require("path");
+var readline = require("readline");
+var vm = require("vm");
+
+var repo = process.argv[2];
+var logging = !!process.env.HOST_LOG;
+var appKeys = JSON.parse(fs.readFileSync(path.join(repo, "appinfo.json"), "utf8")).appKeys;
+var keyNames = {};
+Object.keys(appKeys).forEach(function (name) { keyNames[appKeys[name]] = name; });
+
+var now = 0;
+var localZone = "UTC";
+var output = [];
+
+// Timers, in simulated time
+var timers = [];
+var nextTimerId = 1;
+
+function setTimeout(fn, delay) {
+  var timer = { id: nextTimerId++, at: now + Math.max(0, delay || 0), fn: fn };
+  timers.push(timer);
+  return timer.id;
+}
+
+function clearTimeout(id) {
+  timers = timers.filter(function (timer) { return timer.id !== id; });
+}
+
+function runTimers() {
+  for (;;) {
+    var due = null;
+    timers.forEach(function (timer) {
+      if (timer.at <= now && (due === null || timer.at < due.at || (timer.at === due.at && timer.id < due.id))) {
+        due = timer;
+      }
+    });
+    if (due === null) {
+      return;
+    }
+    clearTimeout(due.id);
+    due.fn();
+  }
+}
+
+function nextTimer() {
+  return timers.reduce(function (next, timer) { return next < 0 || timer.at < next ? timer.at : next; }, -1);
+}
+
+// localStorage, kept for the life of the process
+var store = {};
+var localStorage = {
+  getItem: function (key) { return Object.prototype.hasOwnProperty.call(store, key) ? store[key] : null; },
+  setItem: function (key, value) { store[key] = String(value); },
+  removeItem: function (key) { delete store[key]; },
+  key: function (i) { return Object.keys(store)[i]; },
+  get length() { return Object.keys(store).length; }
+};
+
+// Pebble
+var handlers = {};
+var pending = {};
+var nextMessageId = 1;
+
+function hex(bytes) {
+  return bytes.map(function (b) { return ("0" + (b & 0xff).toString(16)).slice(-2); }).join("");
+}
+
+function unhex(text) {
+  var bytes = [];
+  for (var i = 0; i + 1 < text.length; i += 2) {
+    bytes.push(parseInt(text.substr(i, 2), 16));
+  }
+  return bytes;
+}
+
+var Pebble = {
+  addEventListener: function (name, handler) {
+    (handlers[name] = handlers[name] || []).push(handler);
+  },
+  sendAppMessage: function (message, success, failure) {
+    var id = nextMessageId++;
+    var tuples = [];
+    Object.keys(message).forEach(function (name) {
+      var value = message[name];
+      var key = appKeys[name] !== undefined ? appKeys[name] : Number(name);
+      if (value === undefined || value === null) {
+        return;
+      } else if (Array.isArray(value)) {
+        tuples.push(key + ":b:" + hex(value));
+      } else if (typeof value === "string") {
+        tuples.push(key + ":s:" + hex(Array.prototype.slice.call(Buffer.from(value, "utf8"))));
+      } else {
+        tuples.push(key + ":i:" + Number(value));
+      }
+    });
+    pending[id] = { success: success, failure: failure };
+    output.push("send " + id + " " + tuples.join(" "));
+    return id;
+  },
+  openURL: function (url) {
+  }
+};
+
+function fire(name, e) {
+  (handlers[name] || []).forEach(function (handler) { handler(e); });
+}
+
+function log() {
+  if (logging) {
+    output.push("log " + Array.prototype.join.call(arguments, " ").replace(/\n/g, " "));
+  }
+}
+
+var console = { log: log, error: log };
+
+// The JS sandbox, with Date following the simulated clock and zone
+var sandbox;
+
+function start() {
+  handlers = {};
+  pending = {};
+  timers = [];
+  var zoneOffset = function (t) { return sandbox.tz.zone(localZone).offset(t); };
+  var SimDate = class extends Date {
+    constructor() {
+      if (arguments.length === 0) {
+        super(now);
+      } else {
+        super(...arguments);
+      }
+    }
+    getTimezoneOffset() {
+      return zoneOffset(this.getTime());
+    }
+    static now() {
+      return now;
+    }
+  };
+
+  sandbox = vm.createContext({
+    Date: SimDate,
+    Pebble: Pebble,
+    window: { localStorage: localStorage },
+    console: console,
+    setTimeout: setTimeout,
+    clearTimeout: clearTimeout
+  });
+  fs.readdirSync(path.join(repo, "src")).filter(function (name) {
+    return /\.js$/.test(name);
+  }).sort().forEach(function (name) {
+    var file = path.join(repo, "src", name);
+    vm.runInContext(fs.readFileSync(file, "utf8"), sandbox, { filename: file });
+  });
+}
+
+function reference(zone) {
+  var z = sandbox.tz.zone(zone);
+  if (!z) {
+    return "table 0";
+  }
+  var fields = [z.untils.length];
+  for (var i = 0; i < z.untils.length; i++) {
+    fields.push(isFinite(z.untils[i]) ? z.untils[i] : Number.MAX_SAFE_INTEGER, z.offsets[i]);
+  }
+  return "table " + fields.join(" ");
+}
+
+// Offsets from moment-timezone itself, as the phone JS computes them.
+function offsets(zone, from, to, step) {
+  var z = sandbox.tz.zone(zone);
+  if (!z) {
+    return "offsets 0";
+  }
+  var times = [];
+  for (var t = from; t < to; t += step) {
+    times.push(t);
+  }
+  z.untils.forEach(function (until) {
+    if (isFinite(until)) {
+      times.push(until - 60000, until);
+    }
+  });
+  times.sort(function (a, b) { return a - b; });
+
+  var fields = [times.length];
+  times.forEach(function (t) {
+    var next = -1;
+    for (var i = 0; i < z.untils.length; i++) {
+      if (z.untils[i] > t) {
+        next = isFinite(z.untils[i]) ? z.untils[i] : -1;
+        break;
+      }
+    }
+    fields.push(t, -sandbox.tz(t, zone).zone(), next);
+  });
+  return "offsets " + fields.join(" ");
+}
+
+function payload(fields) {
+  var result = {};
+  fields.forEach(function (field) {
+    var parts = field.split(":");
+    var name = keyNames[parts[0]] || parts[0];
+    if (parts[1] === "i") {
+      result[name] = Number(parts[2]);
+    } else if (parts[1] === "s") {
+      result[name] = Buffer.from(unhex(parts[2])).toString("utf8");
+    } else {
+      result[name] = unhex(parts[2]);
+    }
+  });
+  return result;
+}
+
+function command(line) {
+  var fields = line.trim().split(/\s+/);
+  var name = fields[0];
+  if (/^(start|ready|msg|config|ack|nack|run|zone)$/.test(name)) {
+    now = Number(fields[1]);
+  }
+
+  switch (name) {
+    case "start":
+      localZone = fields[2];
+      start();
+      break;
+    case "ready":
+      fire("ready", {});
+      break;
+    case "msg":
+      fire("appmessage", { payload: payload(fields.slice(2)) });
+      break;
+    case "config":
+      var json = Buffer.from(unhex(fields[2] || "")).toString("utf8");
+      fire("webviewclosed", { response: encodeURIComponent(json) });
+      break;
+    case "store":
+      var items = JSON.parse(Buffer.from(unhex(fields[1] || "")).toString("utf8"));
+      Object.keys(items).forEach(function (key) { localStorage.setItem(key, items[key]); });
+      break;
+    case "ack":
+    case "nack":
+      var callbacks = pending[fields[2]];
+      delete pending[fields[2]];
+      if (callbacks && name === "ack" && callbacks.success) {
+        callbacks.success({});
+      } else if (callbacks && name === "nack" && callbacks.failure) {
+        callbacks.failure({ error: { message: "NACK" } });
+      }
+      break;
+    case "run":
+      break;
+    case "zone":
+      localZone = fields[2];
+      break;
+    case "table":
+      output.push(reference(fields[1]));
+      break;
+    case "id":
+      output.push("id " + sandbox.zoneId(fields[1]));
+      break;
+    case "names":
+      output.push("names " + (sandbox.ZONE_IDS.length - 1) + " " + sandbox.ZONE_IDS.slice(1).join(" "));
+      break;
+    case "offsets":
+      output.push(offsets(fields[1], Number(fields[2]), Number(fields[3]), Number(fields[4])));
+      break;
+    case "quit":
+      process.exit(0);
+  }
+
+  runTimers();
+  output.push("next " + nextTimer());
+  process.stdout.write(output.join("\n") + "\n");
+  output = [];
+}
+
+readline.createInterface({ input: process.stdin }).on("line", command);
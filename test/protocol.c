@@ -0,0 +1,252 @@
+/*
+ * Protocol scenarios: the watch code (src/main.c) and the phone JS over a fake
+ * AppMessage link, reporting for each scenario the round trips and bytes each
+ * way, how long the display took to show the right times, and how long it
+ * showed wrong ones in all. Each scenario runs with the timezone rules on the
+ * watch, and with the phone alone.
+ *
+ * Fails if a scenario never shows the right times, or does not end showing them.
+ */
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include "host.h"
+
+#define main watch_main
+#include "../src/main.c"
+#undef main
+
+#include "check.h"
+
+#define MINUTE_MS ((host_ms_t) 60 * 1000)
+#define HOUR_MS (60 * MINUTE_MS)
+#define DAY_MS (24 * HOUR_MS)
+
+// Sunday 30 March 2014 00:30 UTC: Europe/London changes to summer time half an hour in,
+// the US already has, and Australia has not yet changed back.
+#define START_MS ((host_ms_t) 1396139400 * 1000)
+
+static const char *s_configured[CONFIG_SIZE] = {
+  "Asia/Tokyo", "Australia/Sydney", "America/Los_Angeles", "Asia/Kolkata"
+};
+static const char *s_reconfigured[CONFIG_SIZE] = {
+  "Europe/Paris", "Pacific/Auckland", "America/Chicago", "Asia/Dubai"
+};
+
+// Display correctness since the scenario's disturbance: when first correct, and for how long wrong
+static const char **s_expected = s_configured;
+static host_ms_t s_disturbed = -1;
+static host_ms_t s_wrong_since = -1;
+static host_ms_t s_wrong_ms = 0;
+static host_ms_t s_correct_at = -1;
+static char s_error[100];
+
+static void check_display() {
+  bool correct = display_correct(s_expected, s_error, sizeof(s_error));
+  if (s_disturbed < 0) {
+    return;
+  }
+  if (!correct && s_wrong_since < 0) {
+    s_wrong_since = host_now();
+  } else if (correct && s_wrong_since >= 0) {
+    s_wrong_ms += host_now() - s_wrong_since;
+    s_wrong_since = -1;
+  }
+  if (correct && s_correct_at < 0) {
+    s_correct_at = host_now();
+  }
+}
+
+// Start measuring, from a disturbance about to happen.
+static void disturb() {
+  check_display();
+  host_reset_stats();
+  s_disturbed = host_now();
+  s_wrong_since = -1;
+  s_wrong_ms = 0;
+  s_correct_at = -1;
+}
+
+// The configuration as the phone stored it when it configured the watch.
+static void store_phone_configuration(const char *zones[CONFIG_SIZE]) {
+  char json[600];
+  char *p = json;
+  char *end = json + sizeof(json);
+  p += snprintf(p, end - p, "{");
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    p += snprintf(p, end - p, "\"tz%d\":\"%s\",\"l%d\":\"%s\",", i + 1, zones[i] ? zones[i] : "",
+                  i + 1, zones[i] ? strchr(zones[i], '/') + 1 : "");
+  }
+  snprintf(p, end - p, "\"seconds\":\"0\"}");
+  host_phone_store(json);
+}
+
+// A watch configured a month ago, starting with the phone's JS not yet running.
+static void start_watch(bool rules) {
+  host_start(START_MS, "Europe/London");
+  persist_configuration(s_configured, START_MS - 30 * DAY_MS);
+  store_phone_configuration(s_configured);
+  host_after_event = check_display;
+  init();
+  s_rules_available = s_rules_available && rules;
+}
+
+// A watch that has been running, and is up to date.
+static void start_settled(bool rules) {
+  start_watch(rules);
+  host_phone_ready();
+  host_run_for(10 * MINUTE_MS);
+}
+
+// The watch starts with the phone's JS ready a few seconds later.
+static void cold_start(bool rules) {
+  start_watch(rules);
+  disturb();
+  host_run_for(5000);
+  host_phone_ready();
+  host_run_for(3 * HOUR_MS);
+}
+
+static void config_change(bool rules) {
+  start_settled(rules);
+  disturb();
+  s_expected = s_reconfigured;
+  host_phone_configure("{\"tz1\":\"Europe/Paris\",\"tz2\":\"Pacific/Auckland\",\"tz3\":\"America/Chicago\",\"tz4\":\"Asia/Dubai\","
+                       "\"tz5\":\"\",\"tz6\":\"\",\"tz7\":\"\",\"tz8\":\"\","
+                       "\"l1\":\"Paris\",\"l2\":\"Auckland\",\"l3\":\"Chicago\",\"l4\":\"Dubai\","
+                       "\"l5\":\"\",\"l6\":\"\",\"l7\":\"\",\"l8\":\"\",\"seconds\":0}");
+  host_run_for(3 * HOUR_MS);
+}
+
+// A watch still configured by zone name, by an earlier version, with a phone that has
+// no stored configuration: the phone only has the names the watch sends.
+static void legacy(bool rules) {
+  host_start(START_MS, "Europe/London");
+  persist_configuration(s_configured, START_MS - 30 * DAY_MS);
+  int16_t offset[CONFIG_SIZE];
+  persist_read_data(KEY_OFFSETS, offset, sizeof(offset));
+  for (int i = 0; i < CONFIG_SIZE; i++) {
+    persist_write_string(KEY_LEGACY_TZ1 + i, s_configured[i] ? s_configured[i] : "");
+    persist_write_int(KEY_LEGACY_OFFSET1 + i, offset[i]);
+  }
+  persist_delete(KEY_ZONES);
+  persist_delete(KEY_OFFSETS);
+  host_after_event = check_display;
+  init();
+  s_rules_available = s_rules_available && rules;
+  disturb();
+  host_run_for(5000);
+  host_phone_ready();
+  host_run_for(3 * HOUR_MS);
+}
+
+// The phone already has a response saved for the watch's startup request, from before
+// the watch and the phone JS restarted.
+static void replay(bool rules) {
+  host_start(START_MS, "Europe/London");
+  persist_configuration(s_configured, START_MS - 30 * DAY_MS);
+  store_phone_configuration(s_configured);
+  host_phone_ready();
+  host_run_for(MINUTE_MS);
+  host_phone_restart();
+
+  host_after_event = check_display;
+  init();
+  s_rules_available = s_rules_available && rules;
+  host_run_for(5000);
+  disturb();
+  host_phone_ready();
+  host_run_for(HOUR_MS);
+}
+
+static void lossy_link(bool rules) {
+  host_link.drop_percent = 30;
+  cold_start(rules);
+}
+
+static void busy_outbox(bool rules) {
+  host_link.busy_percent = 50;
+  cold_start(rules);
+}
+
+// Out of reach of the phone for two hours, over the change to summer time.
+static void disconnect(bool rules) {
+  start_settled(rules);
+  disturb();
+  host_set_connected(false);
+  host_run_for(2 * HOUR_MS);
+  host_set_connected(true);
+  host_run_for(HOUR_MS);
+}
+
+// The phone, and the watch's clock with it, moves to New York.
+static void travel(bool rules) {
+  start_settled(rules);
+  disturb();
+  host_set_local_zone("America/New_York");
+  host_run_for(3 * HOUR_MS);
+}
+
+typedef struct {
+  const char *name;
+  void (*run)(bool rules);
+  host_ms_t within;       // Must be correct this soon after the disturbance, 0 for no limit
+} Scenario;
+
+static const Scenario s_scenarios[] = {
+  { "cold start", cold_start },
+  { "config", config_change },
+  { "legacy", legacy },
+  { "replay", replay, 1000 },
+  { "30% drops", lossy_link },
+  { "50% busy", busy_outbox },
+  { "disconnect", disconnect },
+  { "travel", travel }
+};
+
+// Run a scenario in a process of its own, as the watch code keeps its state in statics.
+static int run_scenario(const Scenario *scenario, bool rules) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (0 == pid) {
+    scenario->run(rules);
+    check_display();
+    if (s_wrong_since >= 0) {
+      s_wrong_ms += host_now() - s_wrong_since;
+    }
+    host_stop();
+
+    printf("%-11s %-6s watch %3u msgs %5u B, phone %3u msgs %5u B, %2u dropped, %3u busy, %2u failed, ",
+           scenario->name, rules ? "rules" : "phone", host_stats.watch_sends, host_stats.watch_bytes,
+           host_stats.phone_sends, host_stats.phone_bytes, host_stats.drops, host_stats.watch_busy,
+           host_stats.watch_failed);
+    if (s_wrong_since >= 0 || s_correct_at < 0) {
+      printf("FAILED: %s\n", s_error);
+      exit(1);
+    }
+    if (scenario->within && s_correct_at - s_disturbed > scenario->within) {
+      printf("FAILED: correct after %.1f s, not within %.1f s\n",
+             (s_correct_at - s_disturbed) / 1000.0, scenario->within / 1000.0);
+      exit(1);
+    }
+    printf("correct after %5.1f s, wrong for %5.1f s\n",
+           (s_correct_at - s_disturbed) / 1000.0, s_wrong_ms / 1000.0);
+    exit(0);
+  }
+
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+int main(int argc, char **argv) {
+  int failures = 0;
+  for (size_t i = 0; i < sizeof(s_scenarios) / sizeof(s_scenarios[0]); i++) {
+    failures += run_scenario(&s_scenarios[i], true) ? 1 : 0;
+    failures += run_scenario(&s_scenarios[i], false) ? 1 : 0;
+  }
+  if (failures) {
+    printf("%d scenarios failed\n", failures);
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,215 @@
+/*
+ * Soak: 365 days from 2016-01-01, minute by minute (525,600 ticks), of the watch code
+ * (src/main.c) with the phone JS, checking the HH:MM of every row of the main
+ * window against moment-timezone at every minute. The phone travels from
+ * London to New York and to Tokyo, is out of reach for a week twice over DST
+ * changes, and the popup is opened twice a day, with its seconds column. The
+ * battery drains and is charged once a week.
+ *
+ * Reports per day the messages each way, persistent writes, CPU time and an
+ * energy estimate: the watch activity that costs energy, weighted with rough
+ * relative figures for spotting regressions rather than predicting battery life.
+ * A wakeup is ten units, a message either way twenty wakeups plus a unit a byte,
+ * a flash write five wakeups, a redraw two units plus one per 1000 pixels, a
+ * subscription five units and a vibration two hundred wakeups.
+ *
+ * Fails if any row is wrong at any minute, or if the energy estimate is over
+ * the budgets given, for the average day and for the worst day (the Makefile's
+ * ENERGY_BUDGET and ENERGY_BUDGET_WORST): soak [budget] [worst day budget]
+ */
+
+#include "host.h"
+
+#define main watch_main
+#include "../src/main.c"
+#undef main
+
+#include "check.h"
+
+#define MINUTE_MS ((host_ms_t) 60 * 1000)
+#define HOUR_MS (60 * MINUTE_MS)
+#define DAY_MS (24 * HOUR_MS)
+#define DAYS (365)
+
+// 2016-01-01 00:00 UTC
+#define START_MS ((host_ms_t) 1451606400 * 1000)
+
+static const char *s_zones[CONFIG_SIZE] = {
+  "America/Los_Angeles", "America/Sao_Paulo", "Asia/Kolkata", "Australia/Sydney"
+};
+
+// Where the phone is, from a day of the year (0 based) on
+typedef struct {
+  int day;
+  const char *zone;
+  bool connected;
+} Leg;
+
+static const Leg s_legs[] = {
+  { 0, "Europe/London", true },
+  { 60, "America/New_York", true },     // Over the US change to summer time
+  { 80, "Europe/London", true },        // Over the EU change
+  { 90, "Europe/London", false },       // Out of reach over Sydney's change back
+  { 97, "Europe/London", true },
+  { 190, "Asia/Tokyo", true },
+  { 204, "Europe/London", true },
+  { 300, "Europe/London", false },      // Out of reach over the EU and US changes back
+  { 308, "Europe/London", true }
+};
+
+// Per day
+typedef struct {
+  uint32_t requests;
+  uint32_t replies;
+  uint32_t bytes;
+  uint32_t writes;
+  uint32_t wakeups;
+  uint32_t redraws;
+  uint32_t redraw_area;
+  uint32_t vibes;
+  uint32_t subscriptions;
+  uint32_t energy;
+  double cpu_ms;
+} Day;
+
+static Day s_days[DAYS];
+static host_ms_t s_checked = -1;
+static uint32_t s_checks = 0;
+static uint32_t s_wrong = 0;
+
+// At every minute, once the tick has been handled and drawn
+static void check_minute() {
+  char error[100];
+  if (0 != host_now() % MINUTE_MS || s_checked == host_now()) {
+    return;
+  }
+  s_checked = host_now();
+  s_checks++;
+  if (!display_correct(s_zones, error, sizeof(error)) && s_wrong++ < 10) {
+    time_t t = host_now() / 1000;
+    char when[32];
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M", gmtime(&t));
+    printf("soak: %s UTC in %s: %s\n", when, host_local_zone(), error);
+  }
+}
+
+// Open the popup with a double shake, and let it time out.
+static void popup() {
+  host_tap(ACCEL_AXIS_X, 1);
+  host_run_for(600);
+  host_tap(ACCEL_AXIS_X, 1);
+  host_run_for(POPUP_TIMEOUT_MS + 1000);
+}
+
+static void battery(int day, int hour, uint8_t *percent) {
+  if (6 == day % 7 && 20 == hour) {
+    host_set_battery(*percent, true);
+    *percent = 100;
+  } else if (6 == day % 7 && 22 == hour) {
+    host_set_battery(*percent, false);
+  } else if (0 == hour % 16 && *percent > 10) {
+    *percent -= 10;
+    host_set_battery(*percent, false);
+  }
+}
+
+static uint32_t energy_estimate(const Day *day) {
+  return day->wakeups * 10 + (day->requests + day->replies) * 200 + day->bytes + day->writes * 50 +
+         day->redraws * 2 + day->redraw_area / 1000 + day->subscriptions * 5 + day->vibes * 2000;
+}
+
+static double report(const char *what, size_t field, bool cpu) {
+  double total = 0;
+  double most = 0;
+  int most_day = 0;
+  for (int d = 0; d < DAYS; d++) {
+    double value = cpu ? s_days[d].cpu_ms : *(uint32_t *) ((char *) &s_days[d] + field);
+    total += value;
+    if (value > most) {
+      most = value;
+      most_day = d;
+    }
+  }
+  time_t t = (START_MS + most_day * DAY_MS) / 1000;
+  char when[16];
+  strftime(when, sizeof(when), "%Y-%m-%d", gmtime(&t));
+  printf("soak: %-18s %11.0f in all, %10.1f a day, at most %9.0f (%s)\n", what, total, total / DAYS, most, when);
+  return most;
+}
+
+int main(int argc, char **argv) {
+  // No budget, unless given
+  uint32_t budget = argc > 1 ? strtoul(argv[1], NULL, 10) : UINT32_MAX;
+  uint32_t budget_worst = argc > 2 ? strtoul(argv[2], NULL, 10) : UINT32_MAX;
+  host_start(START_MS - DAY_MS, "Europe/London");
+  persist_configuration(s_zones, START_MS - DAY_MS);
+  persist_write_bool(KEY_POPUP_SECONDS, true);
+  init();
+  host_phone_ready();
+  host_run_until(START_MS);
+  host_after_event = check_minute;
+
+  uint8_t percent = 100;
+  int leg = 0;
+  for (int d = 0; d < DAYS; d++) {
+    host_reset_stats();
+    clock_t begin = clock();
+
+    for (int h = 0; h < 24; h++) {
+      if (0 == h && leg + 1 < (int) (sizeof(s_legs) / sizeof(s_legs[0])) && d == s_legs[leg + 1].day) {
+        // Move half way through a minute, the watch follows at the next tick.
+        leg++;
+        host_run_for(30 * 1000);
+        if (strcmp(host_local_zone(), s_legs[leg].zone)) {
+          host_set_local_zone(s_legs[leg].zone);
+        }
+        if (host_link.connected != s_legs[leg].connected) {
+          host_set_connected(s_legs[leg].connected);
+        }
+      }
+      battery(d, h, &percent);
+      if (8 == h || 18 == h) {
+        host_run_for(15 * MINUTE_MS + 20 * 1000);
+        popup();
+      }
+      host_run_until(START_MS + d * DAY_MS + (h + 1) * HOUR_MS);
+    }
+
+    s_days[d].requests = host_stats.watch_sends;
+    s_days[d].replies = host_stats.phone_sends;
+    s_days[d].bytes = host_stats.watch_bytes + host_stats.phone_bytes;
+    s_days[d].writes = host_stats.persist_writes;
+    s_days[d].wakeups = host_stats.wakeups;
+    s_days[d].redraws = host_stats.redraws;
+    s_days[d].redraw_area = host_stats.redraw_area;
+    s_days[d].vibes = host_stats.vibes;
+    s_days[d].subscriptions = host_stats.subscriptions;
+    s_days[d].energy = energy_estimate(&s_days[d]);
+    s_days[d].cpu_ms = (clock() - begin) * 1000.0 / CLOCKS_PER_SEC;
+  }
+  host_stop();
+
+  printf("soak: %u minutes checked, %u wrong\n", s_checks, s_wrong);
+  report("watch requests", offsetof(Day, requests), false);
+  report("phone messages", offsetof(Day, replies), false);
+  report("message bytes", offsetof(Day, bytes), false);
+  report("persistent writes", offsetof(Day, writes), false);
+  report("wakeups", offsetof(Day, wakeups), false);
+  report("redraws", offsetof(Day, redraws), false);
+  report("pixels redrawn", offsetof(Day, redraw_area), false);
+  report("vibrations", offsetof(Day, vibes), false);
+  report("subscriptions", offsetof(Day, subscriptions), false);
+  report("CPU ms (host)", 0, true);
+  double worst = report("energy units", offsetof(Day, energy), false);
+
+  double mean = 0;
+  for (int d = 0; d < DAYS; d++) {
+    mean += s_days[d].energy / (double) DAYS;
+  }
+  bool over = mean > budget || worst > budget_worst;
+  if (over) {
+    printf("soak: energy over budget: %.0f units a day (budget %u), %.0f on the worst day (budget %u)\n",
+           mean, budget, worst, budget_worst);
+  }
+  return s_wrong || over ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * Timezone rules on the watch (src/tzrules.c, reading the resource compiled by
+ * tools/tzrules.py) against moment-timezone in the phone JS: for every zone ID,
+ * the offset and next transition, monthly from 2000 to 2040 and either side of
+ * every transition. Reports the resource size, and the resource reads and time
+ * per lookup.
+ *
+ * Fails on any difference.
+ */
+
+#include "host.h"
+#include "tzrules.h"
+
+#define DAY_MS ((host_ms_t) 24 * 60 * 60 * 1000)
+#define FROM_MS ((host_ms_t) 946684800 * 1000)   // 2000-01-01
+#define TO_MS ((host_ms_t) 2208988800 * 1000)    // 2040-01-01
+
+static double seconds(struct timespec *t) {
+  return t->tv_sec + t->tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  host_start(FROM_MS, "UTC");
+  if (!tzrules_init()) {
+    printf("tzrules: no rules resource\n");
+    return 1;
+  }
+
+  char **names;
+  int ids = host_zone_names(&names);
+  uint32_t lookups = 0;
+  uint32_t unknown = 0;
+  int failures = 0;
+  double elapsed = 0;
+  host_reset_stats();
+
+  for (int id = 1; id < ids; id++) {
+    HostOffset *reference;
+    int count = host_moment_offsets(names[id], FROM_MS, TO_MS, 30 * DAY_MS, &reference);
+
+    for (int i = 0; i < count || (0 == count && 0 == i); i++) {
+      int32_t offset = 0;
+      time_t next = 0;
+      struct timespec begin, end;
+      clock_gettime(CLOCK_MONOTONIC, &begin);
+      bool known = tzrules_offset(id, count ? reference[i].utc_ms / 1000 : 0, &offset, &next);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      elapsed += seconds(&end) - seconds(&begin);
+      lookups++;
+
+      if (0 == count) {
+        // Neither knows the zone
+        unknown++;
+        if (known) {
+          printf("tzrules: %s (%d) is not known to moment-timezone, but has rules\n", names[id], id);
+          failures++;
+        }
+        break;
+      }
+
+      host_ms_t next_ms = next ? (host_ms_t) next * 1000 : -1;
+      if (!known || offset != reference[i].offset || next_ms != reference[i].next_ms) {
+        if (failures++ < 10) {
+          time_t t = reference[i].utc_ms / 1000;
+          char when[32];
+          strftime(when, sizeof(when), "%Y-%m-%d %H:%M", gmtime(&t));
+          printf("tzrules: %s (%d) at %s UTC: %s offset %ld next %lld, moment-timezone %ld next %lld\n",
+                 names[id], id, when, known ? "rules" : "no rules", (long) offset, (long long) next_ms,
+                 (long) reference[i].offset, (long long) reference[i].next_ms);
+        }
+      }
+    }
+    free(reference);
+  }
+
+  uint32_t resource = resource_size(resource_get_handle(RESOURCE_ID_TZ_RULES));
+  printf("tzrules: %d zone IDs (%u unknown), %u lookups from 2000 to 2040, %d differences from moment-timezone; "
+         "resource %u bytes, %.1f reads (%.0f bytes) and %.2f us a lookup on the host\n",
+         ids - 1, unknown, lookups, failures, resource, (double) host_stats.resource_reads / lookups,
+         (double) host_stats.resource_bytes / lookups, elapsed * 1e6 / lookups);
+  host_stop();
+  return failures ? 1 : 0;
+}
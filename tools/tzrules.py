@@ -0,0 +1,247 @@
+#!/usr/bin/env python
+#
+# Compile the moment-timezone data embedded in src/utc.js into a compact
+# binary rules resource, so that the watch can resolve timezone offsets
+# without asking the phone.
+#
+# Usage: tzrules.py <utc.js> <zoneids.js> <output.bin>
+#
+# Timezones are identified on the watch, and in messages to and from it, by
+# 16-bit IDs: the index of the name in the ZONE_IDS table of zoneids.js, which
+# is also part of the phone JS. Names new to the data are appended to the
+# table, and IDs are never reused, so that IDs persisted on watches stay valid
+# across data updates. ID 0 is no timezone.
+#
+# Resource layout (all values little-endian):
+#
+#   header       "TZR2", uint16 ID count, uint16 zone count
+#   ids          per ID:    uint16 zone (0xffff if not in the data)
+#                (aliases point at the zone they link to)
+#   zones        per zone:  uint16 first transition, uint16 transition count
+#   transitions  per entry: uint32 until (minutes since the epoch, UTC,
+#                0xffffffff for ever), int16 offset (minutes east of UTC)
+#
+# Zones with identical transitions are stored once, and a zone may have any
+# number of transitions: the watch reads them a few at a time.
+#
+# The rules are only as good as the data: the moment-timezone 2014g data in
+# utc.js has transitions from 2010 to 2020. Before, the first offset holds,
+# and after, the last one, for ever, so DST is not followed beyond 2020 on
+# the watch, nor on the phone, until the data is updated.
+#
+
+from __future__ import print_function
+
+import calendar
+import re
+import struct
+import sys
+import time
+
+MAGIC = b'TZR2'
+FOREVER = 0xffffffff
+NO_ZONE = 0xffff
+
+
+def unpack_base60(s):
+    sign = 1
+    if s.startswith('-'):
+        sign = -1
+        s = s[1:]
+    whole, _, fractional = s.partition('.')
+    out = 0
+    for c in whole:
+        out = out * 60 + char_to_int(c)
+    multiplier = 1.0
+    for c in fractional:
+        multiplier /= 60
+        out += char_to_int(c) * multiplier
+    return out * sign
+
+
+def char_to_int(c):
+    code = ord(c)
+    if code > 96:
+        return code - 87
+    if code > 64:
+        return code - 29
+    return code - 48
+
+
+def unpack(packed):
+    """Unpack a zone exactly as moment-timezone does, into (name, [(until, offset)])."""
+    data = packed.split('|')
+    offsets = [unpack_base60(o) for o in data[2].split(' ')]
+    indices = [unpack_base60(i) for i in data[3]]
+    untils = [unpack_base60(u) for u in data[4].split(' ')] if data[4] else []
+
+    transitions = []
+    until = 0
+    for i, index in enumerate(indices):
+        if i == len(indices) - 1:
+            until_minutes = FOREVER
+        else:
+            until += untils[i]
+            until_minutes = int(round(until))
+        # moment offsets are minutes west of UTC
+        transitions.append((until_minutes, -int(round(offsets[int(index)]))))
+    return data[0], transitions
+
+
+def read_data(path):
+    with open(path) as f:
+        source = f.read()
+    start = source.index('loadData({')
+    zones_start = source.index('"zones": [', start)
+    links_start = source.index('"links": [', zones_start)
+    end = source.index(']', links_start)
+    zones = re.findall(r'"([^"]+)"', source[zones_start + len('"zones": ['):links_start])
+    links = re.findall(r'"([^"]+)"', source[links_start + len('"links": ['):end])
+    return zones, links
+
+
+def read_ids(path):
+    try:
+        with open(path) as f:
+            source = f.read()
+    except IOError:
+        return ['']
+    start = source.index('var ZONE_IDS = [')
+    end = source.index('];', start)
+    return re.findall(r'"([^"]*)"', source[start:end])
+
+
+def write_ids(path, ids):
+    with open(path, 'w') as f:
+        f.write('// Timezone IDs shared with the watch: the ID of a zone is its index here.\n')
+        f.write('// Maintained by tools/tzrules.py from the zone data in utc.js. New zones\n')
+        f.write('// are appended and IDs are never reused, as the watch persists them.\n')
+        f.write('var ZONE_IDS = [\n')
+        f.write(',\n'.join('  "%s"' % name for name in ids))
+        f.write('\n];\n')
+
+
+def assign_ids(ids, names):
+    """Append names without an ID, returns the number added."""
+    known = set(ids)
+    added = sorted(name for name in names if name not in known)
+    ids.extend(added)
+    if len(ids) > NO_ZONE:
+        raise ValueError('Too many zone IDs: %d' % len(ids))
+    return len(added)
+
+
+def compile_rules(zones, links, ids):
+    tables = []
+    table_index = {}
+    names = {}
+
+    for packed in zones:
+        name, transitions = unpack(packed)
+        key = tuple(transitions)
+        if key not in table_index:
+            table_index[key] = len(tables)
+            tables.append(transitions)
+        names[name] = table_index[key]
+
+    for link in links:
+        a, b = link.split('|')
+        if a in names:
+            names[b] = names[a]
+        elif b in names:
+            names[a] = names[b]
+
+    assign_ids(ids, names)
+
+    out = bytearray(MAGIC)
+    out += struct.pack('<HH', len(ids), len(tables))
+    for name in ids:
+        out += struct.pack('<H', names.get(name, NO_ZONE))
+    first = 0
+    for transitions in tables:
+        out += struct.pack('<HH', first, len(transitions))
+        first += len(transitions)
+    for transitions in tables:
+        for until, offset in transitions:
+            out += struct.pack('<Ih', until, offset)
+
+    return bytes(out), names, tables
+
+
+def lookup(rules, zone_id, utc_minutes):
+    """Resolve an offset from the compiled rules, as the watch does."""
+    id_count, zone_count = struct.unpack_from('<HH', rules, 4)
+    if zone_id >= id_count:
+        return None
+    zone, = struct.unpack_from('<H', rules, 8 + zone_id * 2)
+    if zone == NO_ZONE:
+        return None
+    zones_at = 8 + id_count * 2
+    first, count = struct.unpack_from('<HH', rules, zones_at + zone * 4)
+    transitions_at = zones_at + zone_count * 4
+    for i in range(count):
+        until, offset = struct.unpack_from('<Ih', rules, transitions_at + (first + i) * 6)
+        if utc_minutes < until:
+            return offset
+    return None
+
+
+def reference(transitions, utc_minutes):
+    # As moment-timezone Zone.offset()
+    for until, offset in transitions:
+        if utc_minutes < until:
+            return offset
+    return None
+
+
+def verify(rules, names, tables, ids):
+    """Check that the compiled rules decode to the transitions unpacked from the data, for every name,
+    monthly over 2000-2040 and either side of each transition.
+
+    This only checks the serialisation: the watch's lookups are compared with moment-timezone itself,
+    running in the phone JS, by test/tzrules.c.
+    """
+    start = calendar.timegm((2000, 1, 1, 0, 0, 0)) // 60
+    end = calendar.timegm((2040, 1, 1, 0, 0, 0)) // 60
+    checks = 0
+    for name, zone in sorted(names.items()):
+        zone_id = ids.index(name)
+        instants = list(range(start, end, 30 * 24 * 60))
+        instants += [u + d for u, _ in tables[zone] if u != FOREVER for d in (-1, 0)]
+        for t in instants:
+            if lookup(rules, zone_id, t) != reference(tables[zone], t):
+                raise ValueError('Mismatch for %s at %d' % (name, t))
+            checks += 1
+    return checks
+
+
+def main(argv):
+    if len(argv) != 4:
+        print('Usage: %s <utc.js> <zoneids.js> <output.bin>' % argv[0], file=sys.stderr)
+        return 1
+
+    zones, links = read_data(argv[1])
+    ids = read_ids(argv[2])
+    known_ids = len(ids)
+    rules, names, tables = compile_rules(zones, links, ids)
+
+    begin = time.time()
+    checks = verify(rules, names, tables, ids)
+    elapsed = time.time() - begin
+
+    if len(ids) != known_ids:
+        write_ids(argv[2], ids)
+    with open(argv[3], 'wb') as f:
+        f.write(rules)
+
+    untils = [u for t in tables for u, _ in t if u != FOREVER]
+    print('tzrules: %d names (%d new IDs), %d distinct zones, %d transitions (%s to %s, at most %d a zone), %d bytes; '
+          '%d lookups round-tripped (%.1f us each)' % (
+              len(names), len(ids) - known_ids, len(tables), sum(len(t) for t in tables),
+              time.strftime('%Y-%m-%d', time.gmtime(min(untils) * 60)), time.strftime('%Y-%m-%d', time.gmtime(max(untils) * 60)),
+              max(len(t) for t in tables), len(rules), checks, elapsed * 1e6 / max(checks, 1)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))